@@ -1,8 +1,10 @@
 #!/usr/bin/env sh
-# Build the UCG library.
+# Build the UCG library. Extra flags may be passed in CFLAGS, such as
+# CFLAGS=-mavx2 to build the AVX2 paths. Programs that link the library need
+# -lpthread as well, unless it is built with CFLAGS=-DUCG_NO_THREADS.
 set -xe
 mkdir -p lib
-cc -c src/ucg.c -o lib/ucg.o -std=c99 -pedantic-errors -Wall -Werror
+cc -c src/ucg.c -o lib/ucg.o -std=c99 -pedantic-errors -Wall -Werror $CFLAGS
 ar rcs lib/libucg.a lib/ucg.o
 ranlib lib/libucg.a
 set +xe
@@ -4,16 +4,52 @@
  */
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "ucg.h"
-#include "ucg_tables.h"
+#include "ucg_trie.h"
+#include "ucg_dfa.h"
+
+// Vector extensions are picked up from the compiler's target flags, such as
+// `-mavx2` or `/arch:AVX2`. Define `UCG_NO_SIMD` to force the portable path.
+#if !defined(UCG_NO_SIMD)
+#  if defined(__AVX2__)
+#    define UCG_AVX2 1
+#    include <immintrin.h>
+#  endif
+#  if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define UCG_SSE2 1
+#    include <emmintrin.h>
+#  endif
+#endif
+
+// Grapheme boundaries are decided by the state machine in `ucg_dfa.h`, which is
+// generated from the chain of rules below. Define `UCG_RULE_CHAIN` to walk the
+// chain of rules directly instead.
+
+// `ucg_decode_grapheme_clusters_parallel` uses POSIX threads, or Win32 threads
+// on Windows. Define `UCG_NO_THREADS` to always segment on the calling thread.
+#if !defined(UCG_NO_THREADS)
+#  if defined(_WIN32)
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#  else
+#    include <pthread.h>
+#  endif
+#endif
+
+// Below this many bytes per thread, starting the threads costs more than it
+// saves.
+#if !defined(UCG_PARALLEL_MIN_BYTES)
+#  define UCG_PARALLEL_MIN_BYTES (256 * 1024)
+#endif
+
+#define UCG_PARALLEL_MAX_THREADS 256
+
+// How far back from an even split to look for a rune to resume decoding from.
+#define UCG_PARALLEL_SYNC_WINDOW 4096
 
-#define UCG_TABLE_LEN(t) (sizeof(t) / sizeof(ucg_rune))
-
-#define ZERO_WIDTH_SPACE      0x200B
-#define ZERO_WIDTH_NON_JOINER 0x200C
 #define ZERO_WIDTH_JOINER     0x200D
-#define WORD_JOINER           0x2060
 
 void *ucg_default_malloc(intptr_t size, void *ctx)
 {
@@ -85,6 +121,10 @@ ucg_rune ucg_decode_rune(const uint8_t* str, ucg_int strlen, ucg_int* byte_itera
 		for (more -= 1; more >= 0; more -= 1) {
 			c += 1; *byte_iterator += 1;
 			if (c == end) { return UCG_EXPECTED_MORE_BYTES; }
+			// A sequence cut short by anything other than a continuation byte
+			// is malformed. Rejecting it keeps decoding self-synchronizing, so
+			// that the runes of a piece of text never depend on what precedes it.
+			if ((*c & 0xC0) != 0x80) { return UCG_INVALID_RUNE; }
 			rune |= (*c & 0x3F) << (more * 6);
 		}
 
@@ -92,27 +132,593 @@ ucg_rune ucg_decode_rune(const uint8_t* str, ucg_int strlen, ucg_int* byte_itera
 	}
 }
 
-ucg_int ucg_binary_search(ucg_rune value, const ucg_rune* table, ucg_int length, ucg_int stride) {
-	assert(table != NULL);
-	assert(length > 0);
-	assert(stride > 0);
+// This is how many bytes past the end of `ucg_valid_utf8_prefix` should be
+// decoded one rune at a time before trying it again.
+#define UCG_UTF8_BLOCK_SIZE 32
+
+#if defined(UCG_AVX2)
+static int ucg_count_set_bits(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcount(x);
+#else
+	x = x - ((x >> 1) & 0x55555555u);
+	x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+	x = (x + (x >> 4)) & 0x0F0F0F0Fu;
+	return (int)((x * 0x01010101u) >> 24);
+#endif
+}
+#endif
+
+#if defined(UCG_AVX2)
+// This decodes bytes that are already known to be well-formed UTF-8, and
+// returns the number of runes written to `out_runes`.
+static ucg_int ucg_decode_valid_runes(const uint8_t* str, ucg_int str_len, uint32_t* out_runes) {
+	ucg_int n = 0;
+
+	ucg_int byte_index = 0;
+	while (byte_index < str_len) {
+		if (str_len - byte_index >= 8) {
+			__m128i bytes = _mm_loadl_epi64((const __m128i*)(str + byte_index));
+			if (_mm_movemask_epi8(bytes) == 0) {
+				_mm256_storeu_si256((__m256i*)(out_runes + n), _mm256_cvtepu8_epi32(bytes));
+				n += 8;
+				byte_index += 8;
+				continue;
+			}
+		}
 
-	ucg_int n = length;
-	ucg_int t = 0;
-	for (/**/; n > 1; /**/) {
-		ucg_int m = n / 2;
-		ucg_int p = t + m * stride;
-		if (value >= table[p]) {
-			t = p;
-			n = n - m;
+		const uint8_t* c = str + byte_index;
+		if (c[0] < 0x80) {
+			out_runes[n] = c[0];
+			byte_index += 1;
+		} else if (c[0] < 0xE0) {
+			out_runes[n] = (uint32_t)(c[0] & 0x1F) << 6 | (uint32_t)(c[1] & 0x3F);
+			byte_index += 2;
+		} else if (c[0] < 0xF0) {
+			out_runes[n] = (uint32_t)(c[0] & 0x0F) << 12 | (uint32_t)(c[1] & 0x3F) << 6 | (uint32_t)(c[2] & 0x3F);
+			byte_index += 3;
 		} else {
-			n = m;
+			out_runes[n] = (uint32_t)(c[0] & 0x07) << 18 | (uint32_t)(c[1] & 0x3F) << 12 | (uint32_t)(c[2] & 0x3F) << 6 | (uint32_t)(c[3] & 0x3F);
+			byte_index += 4;
 		}
+		n += 1;
 	}
-	if (n != 0 && value >= table[t]) {
-		return t;
+
+	return n;
+}
+#endif
+
+// Returns how many bytes from the start of `str` are certain to be well-formed
+// UTF-8, ending on a rune boundary, and stores how many runes they hold in
+// `out_rune_count`. It may stop short of the first malformed rune, so the
+// bytes after it should be checked with `ucg_decode_rune`.
+//
+// If `out_runes` is not NULL, the runes are decoded into it as well.
+static ucg_int ucg_valid_utf8_prefix(const uint8_t* str, ucg_int str_len, uint32_t* out_runes, ucg_int* out_rune_count) {
+	ucg_int n = 0;
+	ucg_int rune_count = 0;
+
+#if defined(UCG_AVX2)
+	// This is the method of Keiser and Lemire, "Validating UTF-8 In Less Than
+	// One Instruction Per Byte". Each pair of adjacent bytes is classified by
+	// three table lookups on their nibbles, and any sequence that is too long,
+	// too short, overlong, a surrogate or past U+10FFFF leaves a bit set.
+	//
+	// The one difference from `ucg_decode_rune` is that it accepts overlong
+	// sequences led by 0xC1, which are sent down the slow path here.
+	enum {
+		TOO_SHORT      = 1 << 0,
+		TOO_LONG       = 1 << 1,
+		OVERLONG_3     = 1 << 2,
+		TOO_LARGE      = 1 << 3,
+		SURROGATE      = 1 << 4,
+		OVERLONG_2     = 1 << 5,
+		TOO_LARGE_1000 = 1 << 6,
+		OVERLONG_4     = 1 << 6,
+		TWO_CONTS      = 1 << 7,
+		CARRY          = TOO_SHORT | TOO_LONG | TWO_CONTS,
+	};
+
+	static const uint8_t byte_1_high_table[16] = {
+		// 0_______ ________
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		// 10______ ________
+		TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+		// 1100____ ________
+		TOO_SHORT | OVERLONG_2,
+		// 1101____ ________
+		TOO_SHORT,
+		// 1110____ ________
+		TOO_SHORT | OVERLONG_3 | SURROGATE,
+		// 1111____ ________
+		TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+	};
+
+	static const uint8_t byte_1_low_table[16] = {
+		// ____0000 ________
+		CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+		// ____0001 ________
+		CARRY | OVERLONG_2,
+		// ____001_ ________
+		CARRY,
+		CARRY,
+		// ____0100 ________
+		CARRY | TOO_LARGE,
+		// ____0101 ________
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		// ____011_ ________
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		// ____1___ ________
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		// ____1101 ________
+		CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+	};
+
+	static const uint8_t byte_2_high_table[16] = {
+		// ________ 0_______
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		// ________ 1000____
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+		// ________ 1001____
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+		// ________ 101_____
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+		// ________ 11______
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	};
+
+	// Each lookup is the same 16 entries in both halves of the register.
+	const __m256i byte_1_high_lookup = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)byte_1_high_table));
+	const __m256i byte_1_low_lookup  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)byte_1_low_table));
+	const __m256i byte_2_high_lookup = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)byte_2_high_table));
+
+	// Only a lead byte in one of the last three places of a block can be
+	// waiting for continuation bytes in the next block.
+	const __m256i incomplete_floor = _mm256_setr_epi8(
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		(char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+
+	const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+	__m256i previous = _mm256_setzero_si256();
+
+	for (/**/; str_len - n >= 32; n += 32) {
+		__m256i input = _mm256_loadu_si256((const __m256i*)(str + n));
+
+		// A block of 7-bit ASCII is valid on its own.
+		if (_mm256_movemask_epi8(input) == 0) {
+			__m256i incomplete = _mm256_subs_epu8(previous, incomplete_floor);
+			if (!_mm256_testz_si256(incomplete, incomplete)) {
+				break;
+			}
+			rune_count += 32;
+			previous = input;
+			continue;
+		}
+
+		// The bytes one, two and three places before each byte of `input`.
+		__m256i carried = _mm256_permute2x128_si256(previous, input, 0x21);
+		__m256i prev1 = _mm256_alignr_epi8(input, carried, 15);
+		__m256i prev2 = _mm256_alignr_epi8(input, carried, 14);
+		__m256i prev3 = _mm256_alignr_epi8(input, carried, 13);
+
+		__m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_lookup, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble));
+		__m256i byte_1_low  = _mm256_shuffle_epi8(byte_1_low_lookup, _mm256_and_si256(prev1, low_nibble));
+		__m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_lookup, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble));
+		__m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+		// The third and fourth bytes of a rune must be continuation bytes,
+		// which the lookups above only tell apart from the second.
+		__m256i third_or_fourth = _mm256_or_si256(
+			_mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80))),
+			_mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80))));
+		__m256i error = _mm256_xor_si256(_mm256_and_si256(third_or_fourth, _mm256_set1_epi8((char)0x80)), special);
+
+		if (!_mm256_testz_si256(error, error)) {
+			break;
+		}
+
+		// Every byte but a continuation byte begins a rune.
+		__m256i starts = _mm256_cmpgt_epi8(input, _mm256_set1_epi8((char)0xBF));
+		rune_count += ucg_count_set_bits((uint32_t)_mm256_movemask_epi8(starts));
+		previous = input;
 	}
-	return -1;
+
+	// A rune left unfinished by the last block has not been checked yet.
+	for (ucg_int i = 1; i <= 3 && i <= n; i += 1) {
+		uint8_t byte = str[n - i];
+		if ((byte & 0xC0) == 0x80) {
+			continue;
+		}
+		if (byte >= 0xC0 && (byte < 0xE0 ? 2 : byte < 0xF0 ? 3 : 4) > i) {
+			n -= i;
+			rune_count -= 1;
+		}
+		break;
+	}
+
+	if (out_runes != NULL) {
+		ucg_decode_valid_runes(str, n, out_runes);
+	}
+#endif
+
+	// The portable path checks 7-bit ASCII a word at a time and every other
+	// rune on its own, up to the first one it is not sure of.
+	while (n < str_len) {
+		ucg_int ascii_start = n;
+		for (/**/; str_len - n >= 8; n += 8) {
+			uint64_t word;
+			memcpy(&word, str + n, sizeof(word));
+			if ((word & 0x8080808080808080ull) != 0) {
+				break;
+			}
+		}
+		if (out_runes != NULL) {
+			for (ucg_int i = ascii_start; i < n; i += 1) {
+				out_runes[rune_count + i - ascii_start] = str[i];
+			}
+		}
+		rune_count += n - ascii_start;
+		if (n == str_len) {
+			break;
+		}
+
+		const uint8_t* c = str + n;
+		ucg_int length;
+		if      (c[0] <= 0x7F)                { length = 1; }
+		else if (0xC2 <= c[0] && c[0] <= 0xDF) { length = 2; }
+		else if (0xE0 <= c[0] && c[0] <= 0xEF) { length = 3; }
+		else if (0xF0 <= c[0] && c[0] <= 0xF4) { length = 4; }
+		else                                  { break; }
+
+		if (length > str_len - n) {
+			break;
+		}
+		if (length > 1) {
+			if      (c[0] == 0xE0 && c[1] < 0xA0) { break; }
+			else if (c[0] == 0xED && c[1] > 0x9F) { break; }
+			else if (c[0] == 0xF0 && c[1] < 0x90) { break; }
+			else if (c[0] == 0xF4 && c[1] > 0x8F) { break; }
+
+			bool continued = true;
+			for (ucg_int i = 1; i < length; i += 1) {
+				continued &= (c[i] & 0xC0) == 0x80;
+			}
+			if (!continued) {
+				break;
+			}
+		}
+
+		if (out_runes != NULL) {
+			uint32_t rune = length == 1 ? c[0] : c[0] & (0x7Fu >> length);
+			for (ucg_int i = 1; i < length; i += 1) {
+				rune = rune << 6 | (c[i] & 0x3Fu);
+			}
+			out_runes[rune_count] = rune;
+		}
+
+		n += length;
+		rune_count += 1;
+	}
+
+	*out_rune_count = rune_count;
+	return n;
+}
+
+// The rune block is the front end of the segmentation loop. Runes are decoded
+// in bulk, many bytes at a time where possible, and the rule engine consumes
+// the block afterwards.
+//
+// Runs of 7-bit ASCII are widened into runes a vector at a time. Other runes
+// are checked by `ucg_valid_utf8_prefix`, which is vectorized under AVX2, and
+// then decoded without any further checks.
+#define UCG_RUNE_BLOCK_SIZE 128
+
+typedef struct {
+	uint32_t runes[UCG_RUNE_BLOCK_SIZE];
+	uint8_t  lengths[UCG_RUNE_BLOCK_SIZE];
+	ucg_int  length;
+
+	// If decoding stopped early due to a parsing error, this is set to the
+	// error, and the offending rune begins right after the last one decoded.
+	ucg_int  error;
+} ucg_rune_block;
+
+#if defined(UCG_SSE2) || defined(UCG_AVX2)
+static int ucg_count_trailing_zeros(uint32_t x) {
+	assert(x != 0);
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz(x);
+#else
+	int n = 0;
+	for (/**/; (x & 1) == 0; x >>= 1) {
+		n += 1;
+	}
+	return n;
+#endif
+}
+#endif
+
+static void ucg_decode_rune_block(const uint8_t* str, ucg_int str_len, ucg_int byte_index, ucg_rune_block* block) {
+	ucg_int n = 0;
+
+	block->error = 0;
+
+	while (byte_index < str_len) {
+		// The vectorized paths widen a whole chunk of bytes into runes, then
+		// keep however many of them were 7-bit ASCII before the first byte
+		// with the high bit set.
+		ucg_int ascii = 0;
+#if defined(UCG_AVX2)
+		if (str_len - byte_index >= 32 && UCG_RUNE_BLOCK_SIZE - n >= 32) {
+			__m256i bytes = _mm256_loadu_si256((const __m256i*)(str + byte_index));
+			__m128i lo = _mm256_castsi256_si128(bytes);
+			__m128i hi = _mm256_extracti128_si256(bytes, 1);
+			_mm256_storeu_si256((__m256i*)(block->runes + n     ), _mm256_cvtepu8_epi32(lo));
+			_mm256_storeu_si256((__m256i*)(block->runes + n +  8), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+			_mm256_storeu_si256((__m256i*)(block->runes + n + 16), _mm256_cvtepu8_epi32(hi));
+			_mm256_storeu_si256((__m256i*)(block->runes + n + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8(bytes);
+			ascii = mask == 0 ? 32 : ucg_count_trailing_zeros(mask);
+		} else
+#endif
+#if defined(UCG_SSE2)
+		if (str_len - byte_index >= 16 && UCG_RUNE_BLOCK_SIZE - n >= 16) {
+			__m128i bytes = _mm_loadu_si128((const __m128i*)(str + byte_index));
+			__m128i zero = _mm_setzero_si128();
+			__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+			__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+			_mm_storeu_si128((__m128i*)(block->runes + n     ), _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)(block->runes + n +  4), _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)(block->runes + n +  8), _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128((__m128i*)(block->runes + n + 12), _mm_unpackhi_epi16(hi, zero));
+
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(bytes);
+			ascii = mask == 0 ? 16 : ucg_count_trailing_zeros(mask);
+		} else
+#endif
+		// The portable path checks eight bytes at a time for 7-bit ASCII.
+		if (str_len - byte_index >= 8 && UCG_RUNE_BLOCK_SIZE - n >= 8) {
+			uint64_t word;
+			memcpy(&word, str + byte_index, sizeof(word));
+			if ((word & 0x8080808080808080ull) == 0) {
+				for (ucg_int i = 0; i < 8; i += 1) {
+					block->runes[n + i] = str[byte_index + i];
+				}
+				ascii = 8;
+			}
+		}
+
+		if (ascii > 0) {
+			memset(block->lengths + n, 1, (size_t)ascii);
+			n += ascii;
+			byte_index += ascii;
+			continue;
+		}
+
+		if (n == UCG_RUNE_BLOCK_SIZE) {
+			break;
+		}
+
+		if (str[byte_index] <= 0x7F) {
+			block->runes[n] = str[byte_index];
+			block->lengths[n] = 1;
+			n += 1;
+			byte_index += 1;
+			continue;
+		}
+
+#if defined(UCG_AVX2)
+		// There is a rune for every byte at most, so checking no more bytes
+		// than there are runes left in the block keeps them from overflowing.
+		// Fewer bytes than a vector are not worth the setup.
+		ucg_int window = UCG_RUNE_BLOCK_SIZE - n;
+		if (window > str_len - byte_index) {
+			window = str_len - byte_index;
+		}
+		if (window >= 32) {
+			ucg_int valid_runes;
+			ucg_int valid = ucg_valid_utf8_prefix(str + byte_index, window, block->runes + n, &valid_runes);
+			if (valid > 0) {
+				for (ucg_int i = 0; i < valid_runes; i += 1) {
+					uint32_t r = block->runes[n + i];
+					block->lengths[n + i] = (uint8_t)(r < 0x80 ? 1 : r < 0x800 ? 2 : r < 0x10000 ? 3 : 4);
+				}
+				n += valid_runes;
+				byte_index += valid;
+				continue;
+			}
+		}
+#endif
+
+		// Whatever the check was unsure of is decoded on its own, which
+		// also finds the error, if there is one.
+		ucg_int byte_iterator = byte_index;
+		ucg_rune rune = ucg_decode_rune(str, str_len, &byte_iterator);
+		if (rune < 0) {
+			block->error = (ucg_int)rune;
+			break;
+		}
+
+		block->runes[n] = (uint32_t)rune;
+		block->lengths[n] = (uint8_t)(byte_iterator - byte_index);
+		n += 1;
+		byte_index = byte_iterator;
+	}
+
+	block->length = n;
+}
+
+// Returns how many bytes from the start of `str` are printable 7-bit ASCII,
+// that is, in the range of 0x20 to 0x7E.
+static ucg_int ucg_printable_ascii_run(const uint8_t* str, ucg_int str_len) {
+	ucg_int n = 0;
+
+#if defined(UCG_AVX2)
+	for (/**/; str_len - n >= 32; n += 32) {
+		__m256i bytes = _mm256_loadu_si256((const __m256i*)(str + n));
+		__m256i printable = _mm256_and_si256(
+			_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(0x1F)),
+			_mm256_cmpgt_epi8(_mm256_set1_epi8(0x7F), bytes));
+
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(printable);
+		if (mask != 0xFFFFFFFFu) {
+			return n + ucg_count_trailing_zeros(~mask);
+		}
+	}
+#endif
+#if defined(UCG_SSE2)
+	for (/**/; str_len - n >= 16; n += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(str + n));
+		__m128i printable = _mm_and_si128(
+			_mm_cmpgt_epi8(bytes, _mm_set1_epi8(0x1F)),
+			_mm_cmplt_epi8(bytes, _mm_set1_epi8(0x7F)));
+
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(printable);
+		if (mask != 0xFFFFu) {
+			return n + ucg_count_trailing_zeros(~mask);
+		}
+	}
+#endif
+	// The portable path checks eight bytes at a time. A byte is out of range
+	// if it has the high bit set, is below 0x20, or is equal to 0x7F.
+	for (/**/; str_len - n >= 8; n += 8) {
+		uint64_t word;
+		memcpy(&word, str + n, sizeof(word));
+
+		uint64_t below = (word - 0x2020202020202020ull) & ~word;
+		uint64_t del   = ((word ^ 0x7F7F7F7F7F7F7F7Full) - 0x0101010101010101ull) & ~(word ^ 0x7F7F7F7F7F7F7F7Full);
+		if (((word | below | del) & 0x8080808080808080ull) != 0) {
+			break;
+		}
+	}
+
+	for (/**/; n < str_len && 0x20 <= str[n] && str[n] <= 0x7E; n += 1) {
+	}
+
+	return n;
+}
+
+// Text in UTF-16 or UTF-32 goes through the same segmentation loop as UTF-8,
+// read in code units of `unit_size` bytes, and every offset into it counts
+// code units rather than bytes.
+static inline uint32_t ucg_code_unit(const void* str, ucg_int unit_size, ucg_int index) {
+	if (unit_size == 1) {
+		return ((const uint8_t*)str)[index];
+	} else if (unit_size == 2) {
+		return ((const uint16_t*)str)[index];
+	}
+	return ((const uint32_t*)str)[index];
+}
+
+static void ucg_decode_rune_block_utf16(const uint16_t* str, ucg_int str_len, ucg_int index, ucg_rune_block* block) {
+	ucg_int n = 0;
+
+	block->error = 0;
+
+	while (index < str_len && n < UCG_RUNE_BLOCK_SIZE) {
+		uint32_t unit = str[index];
+		if (unit < 0xD800 || 0xDFFF < unit) {
+			block->runes[n] = unit;
+			block->lengths[n] = 1;
+			n += 1;
+			index += 1;
+			continue;
+		}
+
+		// A surrogate must be a high one followed by a low one.
+		if (unit > 0xDBFF) {
+			block->error = UCG_INVALID_RUNE;
+			break;
+		}
+		if (index + 1 == str_len) {
+			block->error = UCG_EXPECTED_MORE_BYTES;
+			break;
+		}
+		uint32_t low = str[index + 1];
+		if (low < 0xDC00 || 0xDFFF < low) {
+			block->error = UCG_INVALID_RUNE;
+			break;
+		}
+
+		block->runes[n] = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+		block->lengths[n] = 2;
+		n += 1;
+		index += 2;
+	}
+
+	block->length = n;
+}
+
+static void ucg_decode_rune_block_utf32(const uint32_t* str, ucg_int str_len, ucg_int index, ucg_rune_block* block) {
+	ucg_int n = 0;
+
+	block->error = 0;
+
+	while (index < str_len && n < UCG_RUNE_BLOCK_SIZE) {
+		uint32_t unit = str[index];
+		if (0x10FFFF < unit || (0xD800 <= unit && unit <= 0xDFFF)) {
+			block->error = UCG_INVALID_RUNE;
+			break;
+		}
+
+		block->runes[n] = unit;
+		block->lengths[n] = 1;
+		n += 1;
+		index += 1;
+	}
+
+	block->length = n;
+}
+
+static void ucg_decode_code_unit_block(const void* str, ucg_int unit_size, ucg_int str_len, ucg_int index, ucg_rune_block* block) {
+	if (unit_size == 1) {
+		ucg_decode_rune_block((const uint8_t*)str, str_len, index, block);
+	} else if (unit_size == 2) {
+		ucg_decode_rune_block_utf16((const uint16_t*)str, str_len, index, block);
+	} else {
+		ucg_decode_rune_block_utf32((const uint32_t*)str, str_len, index, block);
+	}
+}
+
+// Returns how many code units from `index` onwards are printable 7-bit ASCII.
+static ucg_int ucg_printable_ascii_code_unit_run(const void* str, ucg_int unit_size, ucg_int str_len, ucg_int index) {
+	ucg_int n = index;
+	if (unit_size == 1) {
+		return ucg_printable_ascii_run((const uint8_t*)str + index, str_len - index);
+	} else if (unit_size == 2) {
+		const uint16_t* units = (const uint16_t*)str;
+		for (/**/; n < str_len && 0x20 <= units[n] && units[n] <= 0x7E; n += 1) {
+		}
+	} else {
+		const uint32_t* units = (const uint32_t*)str;
+		for (/**/; n < str_len && 0x20 <= units[n] && units[n] <= 0x7E; n += 1) {
+		}
+	}
+	return n - index;
+}
+
+// Every property the segmentation rules need is packed into a single record
+// per codepoint. See `ucg_trie.h` for the layout.
+static ucg_properties ucg_lookup_properties(ucg_rune r) {
+	assert(0 <= r && r <= 0x10FFFF);
+	ucg_int block = ucg_trie_stage1[r >> UCG_TRIE_BLOCK_SHIFT];
+	return ucg_trie_records[ucg_trie_stage2[(block << UCG_TRIE_BLOCK_SHIFT) | (r & UCG_TRIE_BLOCK_MASK)]];
+}
+
+static bool ucg_is_valid_rune(ucg_rune r) {
+	return 0 <= r && r <= 0x10FFFF;
 }
 
 //
@@ -171,38 +777,22 @@ bool ucg_is_prepended_concatenation_mark(ucg_rune r) {
 
 // General_Category=Spacing_Mark
 bool ucg_is_spacing_mark(ucg_rune r) {
-	intptr_t p = ucg_binary_search(r, ucg_spacing_mark_ranges, UCG_TABLE_LEN(ucg_spacing_mark_ranges)/2, 2);
-	if (p >= 0 && ucg_spacing_mark_ranges[p] <= r && r <= ucg_spacing_mark_ranges[p+1]) {
-		return true;
-	}
-	return false;
+	return ucg_is_valid_rune(r) && (ucg_lookup_properties(r) & UCG_PROPERTY_SPACING_MARK) != 0;
 }
 
 // General_Category=Nonspacing_Mark
 bool ucg_is_nonspacing_mark(ucg_rune r) {
-	intptr_t p = ucg_binary_search(r, ucg_nonspacing_mark_ranges, UCG_TABLE_LEN(ucg_nonspacing_mark_ranges)/2, 2);
-	if (p >= 0 && ucg_nonspacing_mark_ranges[p] <= r && r <= ucg_nonspacing_mark_ranges[p+1]) {
-		return true;
-	}
-	return false;
+	return ucg_is_valid_rune(r) && (ucg_lookup_properties(r) & UCG_PROPERTY_NONSPACING_MARK) != 0;
 }
 
 // Extended_Pictographic
 bool ucg_is_emoji_extended_pictographic(ucg_rune r) {
-	intptr_t p = ucg_binary_search(r, ucg_emoji_extended_pictographic_ranges, UCG_TABLE_LEN(ucg_emoji_extended_pictographic_ranges)/2, 2);
-	if (p >= 0 && ucg_emoji_extended_pictographic_ranges[p] <= r && r <= ucg_emoji_extended_pictographic_ranges[p+1]) {
-		return true;
-	}
-	return false;
+	return ucg_is_valid_rune(r) && (ucg_lookup_properties(r) & UCG_PROPERTY_EXTENDED_PICTOGRAPHIC) != 0;
 }
 
 // Grapheme_Extend
 bool ucg_is_grapheme_extend(ucg_rune r) {
-	intptr_t p = ucg_binary_search(r, ucg_grapheme_extend_ranges, UCG_TABLE_LEN(ucg_grapheme_extend_ranges)/2, 2);
-	if (p >= 0 && ucg_grapheme_extend_ranges[p] <= r && r <= ucg_grapheme_extend_ranges[p+1]) {
-		return true;
-	}
-	return false;
+	return ucg_is_valid_rune(r) && (ucg_lookup_properties(r) & UCG_PROPERTY_GRAPHEME_EXTEND) != 0;
 }
 
 
@@ -223,20 +813,12 @@ bool ucg_is_hangul_syllable_trailing(ucg_rune r) {
 
 // Hangul_Syllable_Type=LV_Syllable
 bool ucg_is_hangul_syllable_lv(ucg_rune r) {
-	intptr_t p = ucg_binary_search(r, ucg_hangul_syllable_lv_singlets, UCG_TABLE_LEN(ucg_hangul_syllable_lv_singlets), 1);
-	if (p >= 0 && r == ucg_hangul_syllable_lv_singlets[p]) {
-		return true;
-	}
-	return false;
+	return ucg_is_valid_rune(r) && UCG_PROPERTY_GCB(ucg_lookup_properties(r)) == UCG_GCB_LV;
 }
 
 // Hangul_Syllable_Type=LVT_Syllable
 bool ucg_is_hangul_syllable_lvt(ucg_rune r) {
-	intptr_t p = ucg_binary_search(r, ucg_hangul_syllable_lvt_ranges, UCG_TABLE_LEN(ucg_hangul_syllable_lvt_ranges)/2, 2);
-	if (p >= 0 && ucg_hangul_syllable_lvt_ranges[p] <= r && r <= ucg_hangul_syllable_lvt_ranges[p+1]) {
-		return true;
-	}
-	return false;
+	return ucg_is_valid_rune(r) && UCG_PROPERTY_GCB(ucg_lookup_properties(r)) == UCG_GCB_LVT;
 }
 
 
@@ -282,20 +864,12 @@ bool ucg_is_indic_conjunct_break_linker(ucg_rune r) {
 
 // Indic_Conjunct_Break=Consonant
 bool ucg_is_indic_conjunct_break_consonant(ucg_rune r) {
-	intptr_t p = ucg_binary_search(r, ucg_indic_conjunct_break_consonant_ranges, UCG_TABLE_LEN(ucg_indic_conjunct_break_consonant_ranges)/2, 2);
-	if (p >= 0 && ucg_indic_conjunct_break_consonant_ranges[p] <= r && r <= ucg_indic_conjunct_break_consonant_ranges[p+1]) {
-		return true;
-	}
-	return false;
+	return ucg_is_valid_rune(r) && UCG_PROPERTY_INCB(ucg_lookup_properties(r)) == UCG_INCB_CONSONANT;
 }
 
 // Indic_Conjunct_Break=Extend
 bool ucg_is_indic_conjunct_break_extend(ucg_rune r) {
-	intptr_t p = ucg_binary_search(r, ucg_indic_conjunct_break_extend_ranges, UCG_TABLE_LEN(ucg_indic_conjunct_break_extend_ranges)/2, 2);
-	if (p >= 0 && ucg_indic_conjunct_break_extend_ranges[p] <= r && r <= ucg_indic_conjunct_break_extend_ranges[p+1]) {
-		return true;
-	}
-	return false;
+	return ucg_is_valid_rune(r) && UCG_PROPERTY_INCB(ucg_lookup_properties(r)) == UCG_INCB_EXTEND;
 }
 
 
@@ -307,7 +881,7 @@ Prepended_Concatenation_Mark = Yes
 ```
 */
 bool ucg_is_gcb_prepend_class(ucg_rune r) {
-	return ucg_is_indic_consonant_preceding_repha(r) || ucg_is_indic_consonant_prefixed(r) || ucg_is_prepended_concatenation_mark(r);
+	return ucg_is_valid_rune(r) && UCG_PROPERTY_GCB(ucg_lookup_properties(r)) == UCG_GCB_PREPEND;
 }
 
 /*
@@ -324,7 +898,7 @@ plus a few General_Category = Spacing_Mark needed for canonical equivalence.
 ```
 */
 bool ucg_is_gcb_extend_class(ucg_rune r) {
-	return ucg_is_grapheme_extend(r) || ucg_is_emoji_modifier(r);
+	return ucg_is_valid_rune(r) && UCG_PROPERTY_GCB(ucg_lookup_properties(r)) == UCG_GCB_EXTEND;
 }
 
 // Return values:
@@ -339,73 +913,183 @@ ucg_int ucg_normalized_east_asian_width(ucg_rune r) {
 	} else if (r <= 0x10FF) {
 		// Easy early out for low runes.
 		return 1;
+	} else if (r > 0x10FFFF) {
+		return 1;
 	}
 
-	switch (r) {
-	// This is a different interpretation of the BOM which occurs in the middle of text.
-	case 0xFEFF: /* ZERO_WIDTH_NO_BREAK_SPACE */
-	case ZERO_WIDTH_SPACE:
-	case ZERO_WIDTH_NON_JOINER:
-	case ZERO_WIDTH_JOINER:
-	case WORD_JOINER:
-		return 0;
-	}
-
-	intptr_t p = ucg_binary_search(r, ucg_normalized_east_asian_width_ranges, UCG_TABLE_LEN(ucg_normalized_east_asian_width_ranges)/3, 3);
-	if (p >= 0 && ucg_normalized_east_asian_width_ranges[p] <= r && r <= ucg_normalized_east_asian_width_ranges[p+1]) {
-		return (ucg_int)ucg_normalized_east_asian_width_ranges[p+2];
-	}
-	return 1;
+	// The zero-width runes, such as the BOM which occurs in the middle of
+	// text, are folded into the table as well.
+	return UCG_PROPERTY_WIDTH(ucg_lookup_properties(r));
 }
 
 //
 // End of Unicode 15.1.0 block.
 //
 
-enum grapheme_cluster_sequence {
-	None,
-	Indic,
-	Emoji,
-	Regional,
-};
 
+ucg_int ucg_grapheme_count(
+	const uint8_t* str,
+	ucg_int str_len,
+
+	ucg_int* out_runes,
+	ucg_int* out_graphemes,
+	ucg_int* out_width
+) {
+	return ucg_decode_grapheme_clusters(NULL, str, str_len, NULL, out_runes, out_graphemes, out_width);
+}
+
+// This is where graphemes are written when the caller provides the memory,
+// either as whole records, as separate columns, or as a bitmap of the bytes
+// where they begin.
+//
+// When wrapping, the graphemes are instead laid out on lines of `wrap_width`
+// columns, and only the offsets where a line is broken are written, so that
+// `capacity` and `length` count offsets rather than graphemes.
+//
+// Unless `width_left` is negative, the buffer is also full once a grapheme
+// would take more columns than are left.
+//
+// If `runes` is not NULL, every rune is written there as well, and the buffer
+// is full once `rune_capacity` of them have been written.
 typedef struct {
 	ucg_grapheme* graphemes;
-	ucg_int rune_count;
-	ucg_int grapheme_count;
-	ucg_int width;
+	const ucg_grapheme_columns* columns;
+	uint8_t* boundaries;
+	ucg_int* wraps;
+	ucg_int capacity;
+	ucg_int length;
+
+	ucg_int wrap_width;
+	ucg_int line_width;
+	ucg_int width_left;
+
+	uint32_t* runes;
+	ucg_int rune_capacity;
+	ucg_int rune_length;
+} ucg_grapheme_buffer;
+
+// This sets up a buffer with room for `capacity` graphemes that writes them
+// nowhere and has no other limit. Outputs and limits are set afterwards.
+static void ucg_grapheme_buffer_init(ucg_grapheme_buffer* buffer, ucg_int capacity) {
+	memset(buffer, 0, sizeof(*buffer));
+	buffer->capacity = capacity;
+	buffer->width_left = -1;
+}
 
-	ucg_rune last_rune;
-	bool last_rune_breaks_forward;
+// The UTF-16 index of a grapheme is not part of its record, so it is passed
+// alongside.
+static void ucg_grapheme_buffer_store(ucg_grapheme_buffer* buffer, ucg_int index, ucg_grapheme grapheme, ucg_int utf16_index) {
+	if (buffer->graphemes != NULL) {
+		buffer->graphemes[index] = grapheme;
+	}
 
-	ucg_int last_width;
-	ucg_int last_grapheme_count;
+	const ucg_grapheme_columns* columns = buffer->columns;
+	if (columns != NULL) {
+		if (columns->fields & UCG_FIELD_BYTE_INDEX)  { columns->byte_indices[index]  = (uint32_t)grapheme.byte_index; }
+		if (columns->fields & UCG_FIELD_RUNE_INDEX)  { columns->rune_indices[index]  = (uint32_t)grapheme.rune_index; }
+		if (columns->fields & UCG_FIELD_WIDTH)       { columns->widths[index]        = (uint8_t)grapheme.width; }
+		if (columns->fields & UCG_FIELD_UTF16_INDEX) { columns->utf16_indices[index] = (uint32_t)utf16_index; }
+	}
+}
 
-	bool bypass_next_rune;
+// A grapheme goes on the next line if it does not fit on this one, unless it
+// would be the first on its line, as there would be no room for it anywhere.
+static bool ucg_grapheme_buffer_wraps_before(const ucg_grapheme_buffer* buffer, ucg_int width) {
+	return buffer->line_width > 0 && buffer->line_width + width > buffer->wrap_width;
+}
 
-	ucg_int regional_indicator_counter;
+// This returns true if there is no room left for a grapheme that begins with a
+// rune of the given properties.
+static bool ucg_grapheme_buffer_is_full(const ucg_grapheme_buffer* buffer, ucg_properties properties) {
+	ucg_int width = UCG_PROPERTY_WIDTH(properties);
+	if (buffer->width_left >= 0 && width > buffer->width_left) {
+		return true;
+	}
+	if (buffer->length < buffer->capacity) {
+		return false;
+	}
+	return buffer->wrap_width == 0 || ucg_grapheme_buffer_wraps_before(buffer, width);
+}
 
-	enum grapheme_cluster_sequence current_sequence;
-	bool continue_sequence;
-} ucg_decoder_state;
+// This returns how many graphemes of printable ASCII there is room for.
+static ucg_int ucg_grapheme_buffer_ascii_room(const ucg_grapheme_buffer* buffer) {
+	ucg_int room = buffer->capacity - buffer->length;
+	if (buffer->wrap_width > 0) {
+		// Each offset left makes room for another full line.
+		ucg_int first_line = buffer->line_width < buffer->wrap_width ? buffer->wrap_width - buffer->line_width : 0;
+		if (room > (INT_FAST32_MAX - first_line) / buffer->wrap_width) {
+			room = INT_FAST32_MAX;
+		} else {
+			room = first_line + room * buffer->wrap_width;
+		}
+	}
 
+	if (buffer->width_left >= 0 && room > buffer->width_left) {
+		room = buffer->width_left;
+	}
+	if (buffer->runes != NULL && room > buffer->rune_capacity - buffer->rune_length) {
+		room = buffer->rune_capacity - buffer->rune_length;
+	}
+	return room;
+}
 
-ucg_int ucg_grapheme_count(
-	const uint8_t* str,
-	ucg_int str_len,
+// This returns true if there is no room left for even a rune that extends the
+// last grapheme.
+static bool ucg_grapheme_buffer_runes_full(const ucg_grapheme_buffer* buffer) {
+	return buffer->runes != NULL && buffer->rune_length == buffer->rune_capacity;
+}
 
-	ucg_int* out_runes,
-	ucg_int* out_graphemes,
-	ucg_int* out_width
-) {
-	return ucg_decode_grapheme_clusters(NULL, str, str_len, NULL, out_runes, out_graphemes, out_width);
+static void ucg_grapheme_buffer_append(ucg_grapheme_buffer* buffer, ucg_grapheme grapheme, ucg_int utf16_index) {
+	if (buffer->width_left >= 0) {
+		assert(grapheme.width <= buffer->width_left);
+		buffer->width_left -= grapheme.width;
+	}
+
+	if (buffer->wrap_width > 0) {
+		if (ucg_grapheme_buffer_wraps_before(buffer, grapheme.width)) {
+			assert(buffer->length < buffer->capacity);
+			buffer->wraps[buffer->length] = grapheme.byte_index;
+			buffer->length += 1;
+			buffer->line_width = 0;
+		}
+		buffer->line_width += grapheme.width;
+		return;
+	}
+
+	assert(buffer->length < buffer->capacity);
+
+	ucg_grapheme_buffer_store(buffer, buffer->length, grapheme, utf16_index);
+
+	if (buffer->boundaries != NULL) {
+		buffer->boundaries[grapheme.byte_index >> 3] |= (uint8_t)(1 << (grapheme.byte_index & 7));
+	}
+
+	buffer->length += 1;
+}
+
+// This sets `count` consecutive bits of the bitmap, starting at bit `start`.
+static void ucg_set_bit_range(uint8_t* bits, ucg_int start, ucg_int count) {
+	ucg_int end = start + count;
+
+	for (/**/; start < end && (start & 7) != 0; start += 1) {
+		bits[start >> 3] |= (uint8_t)(1 << (start & 7));
+	}
+	if (end - start >= 8) {
+		memset(bits + (start >> 3), 0xFF, (size_t)((end - start) >> 3));
+		start += (end - start) & ~(ucg_int)7;
+	}
+	for (/**/; start < end; start += 1) {
+		bits[start >> 3] |= (uint8_t)(1 << (start & 7));
+	}
 }
 
 void _ucg_decode_grapheme_clusters_deferred_step(
 	ucg_allocator* allocator,
+	ucg_grapheme_buffer* buffer,
 	ucg_decoder_state* state,
 	ucg_int byte_index,
-	ucg_rune this_rune
+	ucg_rune this_rune,
+	ucg_properties this_properties
 ) {
 	// "Break at the start and end of text, unless the text is empty."
 	//
@@ -416,7 +1100,13 @@ void _ucg_decode_grapheme_clusters_deferred_step(
 	}
 
 	if (state->grapheme_count > state->last_grapheme_count) {
-		state->width += ucg_normalized_east_asian_width(this_rune);
+		state->width += UCG_PROPERTY_WIDTH(this_properties);
+
+		ucg_grapheme append = {
+			byte_index,
+			state->rune_count,
+			state->width - state->last_width,
+		};
 
 		if (allocator != NULL) {
 			state->graphemes = (ucg_grapheme*)allocator->realloc(
@@ -425,326 +1115,2405 @@ void _ucg_decode_grapheme_clusters_deferred_step(
 				sizeof(ucg_grapheme) * (1 + state->grapheme_count),
 				allocator->ctx);
 
-			ucg_grapheme append = {
-				byte_index,
-				state->rune_count,
-				state->width - state->last_width,
-			};
-
 			state->graphemes[state->grapheme_count - 1] = append;
 		}
 
+		if (buffer != NULL) {
+			ucg_grapheme_buffer_append(buffer, append, state->rune_count + state->supplementary_rune_count);
+		}
+
 		state->last_grapheme_count = state->grapheme_count;
 		state->last_width = state->width;
 	}
 
+	if (buffer != NULL && buffer->runes != NULL) {
+		assert(buffer->rune_length < buffer->rune_capacity);
+		buffer->runes[buffer->rune_length] = (uint32_t)this_rune;
+		buffer->rune_length += 1;
+	}
+
 	state->last_rune = this_rune;
+	state->last_properties = this_properties;
 	state->rune_count += 1;
+	if (this_rune > 0xFFFF) {
+		state->supplementary_rune_count += 1;
+	}
 
 	if (!state->continue_sequence) {
-		state->current_sequence = None;
+		state->current_sequence = UCG_SEQUENCE_NONE;
 		state->regional_indicator_counter = 0;
 	}
 	state->continue_sequence = false;
 }
 
-ucg_int ucg_decode_grapheme_clusters(
+// Printable ASCII can be consumed in bulk whenever the next such rune is sure to
+// begin a grapheme of its own, as every one after it will.
+bool _ucg_decode_grapheme_clusters_breaks_before_ascii(const ucg_decoder_state* state) {
+#if defined(UCG_RULE_CHAIN)
+	return !state->bypass_next_rune;
+#else
+	return ucg_gcb_dfa[state->dfa_state][ucg_gcb_dfa_classes[UCG_GCB_OTHER]] == (UCG_GCB_DFA_BREAK | UCG_GCB_DFA_ASCII);
+#endif
+}
+
+void _ucg_decode_grapheme_clusters_ascii_run(
 	ucg_allocator* allocator,
-	const uint8_t* str,
-	ucg_int str_len,
+	ucg_grapheme_buffer* buffer,
+	ucg_decoder_state* state,
+	const void* str,
+	ucg_int unit_size,
+	ucg_int byte_index,
+	ucg_int run
+) {
+	assert(_ucg_decode_grapheme_clusters_breaks_before_ascii(state));
+	assert(run > 0);
 
-	ucg_grapheme** out_graphemes,
-	ucg_int* out_rune_count,
-	ucg_int* out_grapheme_count,
-	ucg_int* out_width
+	if (allocator != NULL) {
+		state->graphemes = (ucg_grapheme*)allocator->realloc(
+			state->graphemes,
+			sizeof(ucg_grapheme) * (1 + state->grapheme_count),
+			sizeof(ucg_grapheme) * (1 + state->grapheme_count + run),
+			allocator->ctx);
+
+		for (ucg_int i = 0; i < run; i += 1) {
+			ucg_grapheme append = {
+				byte_index + i,
+				state->rune_count + i,
+				1,
+			};
+
+			state->graphemes[state->grapheme_count + i] = append;
+		}
+	}
+
+	if (buffer != NULL && buffer->width_left >= 0) {
+		assert(run <= buffer->width_left);
+		buffer->width_left -= run;
+	}
+
+	if (buffer != NULL && buffer->runes != NULL) {
+		assert(run <= buffer->rune_capacity - buffer->rune_length);
+		for (ucg_int i = 0; i < run; i += 1) {
+			buffer->runes[buffer->rune_length + i] = ucg_code_unit(str, unit_size, byte_index + i);
+		}
+		buffer->rune_length += run;
+	}
+
+	if (buffer != NULL && buffer->wrap_width > 0) {
+		// Every rune is one column wide, so the line is broken every
+		// `wrap_width` runes, starting wherever this line fills up.
+		ucg_int i = buffer->line_width < buffer->wrap_width ? buffer->wrap_width - buffer->line_width : 0;
+		if (i >= run) {
+			buffer->line_width += run;
+		} else {
+			for (/**/; i < run; i += buffer->wrap_width) {
+				buffer->wraps[buffer->length] = byte_index + i;
+				buffer->length += 1;
+				buffer->line_width = run - i;
+			}
+		}
+	} else if (buffer != NULL) {
+		assert(run <= buffer->capacity - buffer->length);
+
+		if (buffer->graphemes != NULL || buffer->columns != NULL) {
+			for (ucg_int i = 0; i < run; i += 1) {
+				ucg_grapheme append = {
+					byte_index + i,
+					state->rune_count + i,
+					1,
+				};
+
+				ucg_grapheme_buffer_store(buffer, buffer->length + i, append, state->rune_count + state->supplementary_rune_count + i);
+			}
+		}
+
+		if (buffer->boundaries != NULL) {
+			ucg_set_bit_range(buffer->boundaries, byte_index, run);
+		}
+
+		buffer->length += run;
+	}
+
+	state->rune_count += run;
+	state->grapheme_count += run;
+	state->width += run;
+
+	state->last_rune = (ucg_rune)ucg_code_unit(str, unit_size, byte_index + run - 1);
+	state->last_properties = ucg_lookup_properties(state->last_rune);
+	state->last_width = state->width;
+	state->last_grapheme_count = state->grapheme_count;
+
+	state->last_rune_breaks_forward = false;
+	state->bypass_next_rune = false;
+
+	state->current_sequence = UCG_SEQUENCE_NONE;
+	state->regional_indicator_counter = 0;
+	state->continue_sequence = false;
+
+	state->dfa_state = UCG_GCB_DFA_ASCII;
+}
+
+void _ucg_decode_grapheme_clusters_rules(
+	ucg_decoder_state* state,
+	ucg_rune this_rune,
+	ucg_properties this_properties
 ) {
-	// The following procedure implements text segmentation by breaking on
-	// Grapheme Cluster Boundaries[1], using the values[2] and rules[3] from
-	// the Unicode® Standard Annex #29, entitled:
-	//
-	// UNICODE TEXT SEGMENTATION
+	int this_gcb  = UCG_PROPERTY_GCB(this_properties);
+	int this_incb = UCG_PROPERTY_INCB(this_properties);
+	int last_gcb  = UCG_PROPERTY_GCB(state->last_properties);
+	int last_incb = UCG_PROPERTY_INCB(state->last_properties);
+
+	// "Do not break between a CR and LF. Otherwise, break before and after controls."
 	//
-	// Version:  Unicode 15.1.0
-	// Date:     2023-08-16
-	// Revision: 43
-	//
-	// This procedure is conformant[4] to UAX29-C1-1, otherwise known as the
-	// extended, non-legacy ruleset.
-	//
-	// Please see the references for more information.
-	//
-	//
-	// [1]: https://www.unicode.org/reports/tr29/#Grapheme_Cluster_Boundaries
-	// [2]: https://www.unicode.org/reports/tr29/#Default_Grapheme_Cluster_Table
-	// [3]: https://www.unicode.org/reports/tr29/#Grapheme_Cluster_Boundary_Rules
-	// [4]: https://www.unicode.org/reports/tr29/#Conformance
-
-	// Additionally, this procedure takes into account Standard Annex #11,
-	// in order to estimate how visually wide the string will appear on a
-	// monospaced display. This can only ever be a rough guess, as this tends
-	// to be an implementation detail relating to which fonts are being used,
-	// how codepoints are interpreted and drawn, if codepoint sequences are
-	// interpreted correctly, and et cetera.
-	//
-	// For example, a program may not properly interpret an emoji modifier
-	// sequence and print the component glyphs instead of one whole glyph.
-	//
-	// See here for more information: https://www.unicode.org/reports/tr11/
-	//
-	// NOTE: There is no explicit mention of what to do with zero-width spaces
-	// as far as grapheme cluster segmentation goes, therefore this
-	// implementation may count and return graphemes with a `width` of zero.
-	//
-	// Treat them as any other space.
-	assert(allocator == NULL || out_graphemes != NULL);
+	// GB3:                 CR   ×   LF
+	// GB4: (Control | CR | LF)  ÷
+	// GB5:                      ÷  (Control | CR | LF)
+	if (this_gcb == UCG_GCB_LF && last_gcb == UCG_GCB_CR) {
+		state->last_rune_breaks_forward = false;
+		state->bypass_next_rune = false;
+		return;
+	}
 
-	ucg_decoder_state state = {0};
+	if (this_gcb == UCG_GCB_CONTROL || this_gcb == UCG_GCB_CR || this_gcb == UCG_GCB_LF) {
+		state->grapheme_count += 1;
+		state->last_rune_breaks_forward = true;
+		state->bypass_next_rune = true;
+		return;
+	}
 
-#define UCG_DEFERRED_DECODE_STEP() (_ucg_decode_grapheme_clusters_deferred_step(allocator, &state, byte_index, this_rune))
+	// (This check is for rules that work forwards, instead of backwards.)
+	if (state->bypass_next_rune) {
+		if (state->last_rune_breaks_forward) {
+			state->grapheme_count += 1;
+			state->last_rune_breaks_forward = false;
+		}
 
-	for (ucg_int byte_index = 0, byte_iterator = 0; byte_index < str_len; byte_index = byte_iterator) {
-		ucg_rune this_rune = ucg_decode_rune(str, str_len, &byte_iterator);
-		if (this_rune < 0) {
-			// There was a Unicode parsing error; bail out.
-			if (out_graphemes != NULL)      { *out_graphemes = state.graphemes; }
-			if (out_rune_count != NULL)     { *out_rune_count = state.rune_count; }
-			if (out_grapheme_count != NULL) { *out_grapheme_count = state.grapheme_count; }
-			if (out_width != NULL)          { *out_width = state.width; }
+		state->bypass_next_rune = false;
+		return;
+	}
 
-			// Return the error.
-			return (ucg_int)this_rune;
-		}
+	// (Optimization 1: Prevent low runes from proceeding further.)
+	//
+	//  * 0xA9 and 0xAE are in the Extended_Pictographic range,
+	//    which is checked later in GB11.
+	if (this_rune != 0xA9 && this_rune != 0xAE && this_rune <= 0x2FF) {
+		state->grapheme_count += 1;
+		return;
+	}
 
-		// "Do not break between a CR and LF. Otherwise, break before and after controls."
+	// (Optimization 2: Check if the rune is in the Hangul space before getting specific.)
+	if (0x1100 <= this_rune && this_rune <= 0xD7FB) {
+		// "Do not break Hangul syllable sequences."
 		//
-		// GB3:                 CR   ×   LF
-		// GB4: (Control | CR | LF)  ÷
-		// GB5:                      ÷  (Control | CR | LF)
-		if (this_rune == '\n' && state.last_rune == '\r') {
-			state.last_rune_breaks_forward = false;
-			state.bypass_next_rune = false;
-			UCG_DEFERRED_DECODE_STEP(); continue;
+		// GB6:        L   ×  (L | V | LV | LVT)
+		// GB7:  (LV | V)  ×  (V | T)
+		// GB8: (LVT | T)  ×   T
+		if (this_gcb == UCG_GCB_L  ||
+		    this_gcb == UCG_GCB_LV ||
+		    this_gcb == UCG_GCB_LVT)
+		{
+			if (last_gcb != UCG_GCB_L) {
+				state->grapheme_count += 1;
+			}
+			return;
 		}
 
-		if (ucg_is_control(this_rune)) {
-			state.grapheme_count += 1;
-			state.last_rune_breaks_forward = true;
-			state.bypass_next_rune = true;
-			UCG_DEFERRED_DECODE_STEP(); continue;
+		if (this_gcb == UCG_GCB_V) {
+			if (last_gcb == UCG_GCB_L ||
+			    last_gcb == UCG_GCB_V ||
+			    last_gcb == UCG_GCB_LV)
+			{
+				return;
+			}
+			state->grapheme_count += 1;
+			return;
 		}
 
-		// (This check is for rules that work forwards, instead of backwards.)
-		if (state.bypass_next_rune) {
-			if (state.last_rune_breaks_forward) {
-				state.grapheme_count += 1;
-				state.last_rune_breaks_forward = false;
+		if (this_gcb == UCG_GCB_T) {
+			if (last_gcb == UCG_GCB_T   ||
+			    last_gcb == UCG_GCB_LVT ||
+			    last_gcb == UCG_GCB_LV  ||
+			    last_gcb == UCG_GCB_V)
+			{
+				return;
 			}
-
-			state.bypass_next_rune = false;
-			UCG_DEFERRED_DECODE_STEP(); continue;
+			state->grapheme_count += 1;
+			return;
 		}
+	}
 
-		// (Optimization 1: Prevent low runes from proceeding further.)
-		//
-		//  * 0xA9 and 0xAE are in the Extended_Pictographic range,
-		//    which is checked later in GB11.
-		if (this_rune != 0xA9 && this_rune != 0xAE && this_rune <= 0x2FF) {
-			state.grapheme_count += 1;
-			UCG_DEFERRED_DECODE_STEP(); continue;
-		}
-
-		// (Optimization 2: Check if the rune is in the Hangul space before getting specific.)
-		if (0x1100 <= this_rune && this_rune <= 0xD7FB) {
-			// "Do not break Hangul syllable sequences."
-			//
-			// GB6:        L   ×  (L | V | LV | LVT)
-			// GB7:  (LV | V)  ×  (V | T)
-			// GB8: (LVT | T)  ×   T
-			if (ucg_is_hangul_syllable_leading(this_rune) ||
-			    ucg_is_hangul_syllable_lv(this_rune)      ||
-			    ucg_is_hangul_syllable_lvt(this_rune))
+	// "Do not break before extending characters or ZWJ."
+	//
+	// GB9:         × (Extend | ZWJ)
+	if (this_gcb == UCG_GCB_ZWJ) {
+		state->continue_sequence = true;
+		return;
+	}
+
+	if (this_gcb == UCG_GCB_EXTEND) {
+		// (Support for GB9c.)
+		if (state->current_sequence == UCG_SEQUENCE_INDIC) {
+			if (this_incb == UCG_INCB_EXTEND      && (
+			    last_incb == UCG_INCB_LINKER      ||
+			    last_incb == UCG_INCB_CONSONANT      ))
 			{
-				if (!ucg_is_hangul_syllable_leading(state.last_rune)) {
-					state.grapheme_count += 1;
-				}
-				UCG_DEFERRED_DECODE_STEP(); continue;
+				state->continue_sequence = true;
+				return;
 			}
 
-			if (ucg_is_hangul_syllable_vowel(this_rune)) {
-				if (ucg_is_hangul_syllable_leading(state.last_rune) ||
-				    ucg_is_hangul_syllable_vowel(state.last_rune)   ||
-				    ucg_is_hangul_syllable_lv(state.last_rune))
-				{
-					UCG_DEFERRED_DECODE_STEP(); continue;
-				}
-				state.grapheme_count += 1;
-				UCG_DEFERRED_DECODE_STEP(); continue;
+			if (this_incb == UCG_INCB_LINKER      && (
+			    last_incb == UCG_INCB_LINKER      ||
+			    last_incb == UCG_INCB_EXTEND      ||
+			    last_incb == UCG_INCB_CONSONANT      ))
+			{
+				state->continue_sequence = true;
+				return;
 			}
 
-			if (ucg_is_hangul_syllable_trailing(this_rune)) {
-				if (ucg_is_hangul_syllable_trailing(state.last_rune) ||
-				    ucg_is_hangul_syllable_lvt(state.last_rune)      ||
-				    ucg_is_hangul_syllable_lv(state.last_rune)       ||
-				    ucg_is_hangul_syllable_vowel(state.last_rune))
-				{
-					UCG_DEFERRED_DECODE_STEP(); continue;
-				}
-				state.grapheme_count += 1;
-				UCG_DEFERRED_DECODE_STEP(); continue;
-			}
+			return;
 		}
 
-		// "Do not break before extending characters or ZWJ."
-		//
-		// GB9:         × (Extend | ZWJ)
-		if (this_rune == ZERO_WIDTH_JOINER) {
-			state.continue_sequence = true;
-			UCG_DEFERRED_DECODE_STEP(); continue;
-		}
-
-		if (ucg_is_gcb_extend_class(this_rune)) {
-			// (Support for GB9c.)
-			if (state.current_sequence == Indic) {
-				if (ucg_is_indic_conjunct_break_extend(this_rune)          && (
-				    ucg_is_indic_conjunct_break_linker(state.last_rune)    ||
-				    ucg_is_indic_conjunct_break_consonant(state.last_rune)    ))
-				{
-					state.continue_sequence = true;
-					UCG_DEFERRED_DECODE_STEP(); continue;
-				}
+		// (Support for GB11.)
+		if (state->current_sequence == UCG_SEQUENCE_EMOJI                    && (
+		    last_gcb == UCG_GCB_EXTEND                                       ||
+		    (state->last_properties & UCG_PROPERTY_EXTENDED_PICTOGRAPHIC) != 0  ))
+		{
+			state->continue_sequence = true;
+		}
 
-				if (ucg_is_indic_conjunct_break_linker(this_rune)          && (
-				    ucg_is_indic_conjunct_break_linker(state.last_rune)    ||
-				    ucg_is_indic_conjunct_break_extend(state.last_rune)    ||
-				    ucg_is_indic_conjunct_break_consonant(state.last_rune)    ))
-				{
-					state.continue_sequence = true;
-					UCG_DEFERRED_DECODE_STEP(); continue;
-				}
+		return;
+	}
+
+	// _The GB9a and GB9b rules only apply to extended grapheme clusters:_
+	// "Do not break before SpacingMarks, or after Prepend characters."
+	//
+	// GB9a:          ×  SpacingMark
+	// GB9b: Prepend  ×
+	if (this_gcb == UCG_GCB_SPACING_MARK) {
+		return;
+	}
+
+	if (this_gcb == UCG_GCB_PREPEND) {
+		state->grapheme_count += 1;
+		state->bypass_next_rune = true;
+		return;
+	}
 
-				UCG_DEFERRED_DECODE_STEP(); continue;
+	// _The GB9c rule only applies to extended grapheme clusters:_
+	// "Do not break within certain combinations with Indic_Conjunct_Break (InCB)=Linker."
+	//
+	// GB9c: \p{InCB=Consonant} [ \p{InCB=Extend} \p{InCB=Linker} ]* \p{InCB=Linker} [ \p{InCB=Extend} \p{InCB=Linker} ]*  ×  \p{InCB=Consonant}
+	if (this_incb == UCG_INCB_CONSONANT) {
+		if (state->current_sequence == UCG_SEQUENCE_INDIC) {
+			if (last_gcb == UCG_GCB_ZWJ          ||
+			    last_incb == UCG_INCB_LINKER)
+			{
+				state->continue_sequence = true;
+			} else {
+				state->grapheme_count += 1;
 			}
+		} else {
+			state->grapheme_count += 1;
+			state->current_sequence = UCG_SEQUENCE_INDIC;
+			state->continue_sequence = true;
+		}
+		return;
+	}
 
-			// (Support for GB11.)
-			if (state.current_sequence == Emoji                     && (
-			    ucg_is_gcb_extend_class(state.last_rune)            ||
-			    ucg_is_emoji_extended_pictographic(state.last_rune)    ))
+	if (this_incb == UCG_INCB_EXTEND) {
+		if (state->current_sequence == UCG_SEQUENCE_INDIC) {
+			if (last_incb == UCG_INCB_CONSONANT ||
+			    last_incb == UCG_INCB_LINKER)
 			{
-				state.continue_sequence = true;
+				state->continue_sequence = true;
+			} else {
+				state->grapheme_count += 1;
 			}
+		}
+		return;
+	}
 
-			UCG_DEFERRED_DECODE_STEP(); continue;
+	if (this_incb == UCG_INCB_LINKER) {
+		if (state->current_sequence == UCG_SEQUENCE_INDIC) {
+			if (last_incb == UCG_INCB_EXTEND ||
+			    last_incb == UCG_INCB_LINKER)
+			{
+				state->continue_sequence = true;
+			} else {
+				state->grapheme_count += 1;
+			}
 		}
+		return;
+	}
 
-		// _The GB9a and GB9b rules only apply to extended grapheme clusters:_
-		// "Do not break before SpacingMarks, or after Prepend characters."
-		//
-		// GB9a:          ×  SpacingMark
-		// GB9b: Prepend  ×
-		if (ucg_is_spacing_mark(this_rune)) {
-			UCG_DEFERRED_DECODE_STEP(); continue;
+	//
+	// (Curiously, there is no GB10.)
+	//
+
+	// "Do not break within emoji modifier sequences or emoji zwj sequences."
+	//
+	// GB11: \p{Extended_Pictographic} Extend* ZWJ  ×  \p{Extended_Pictographic}
+	if ((this_properties & UCG_PROPERTY_EXTENDED_PICTOGRAPHIC) != 0) {
+		if (state->current_sequence != UCG_SEQUENCE_EMOJI || last_gcb != UCG_GCB_ZWJ) {
+			state->grapheme_count += 1;
 		}
+		state->current_sequence = UCG_SEQUENCE_EMOJI;
+		state->continue_sequence = true;
+		return;
+	}
 
-		if (ucg_is_gcb_prepend_class(this_rune)) {
-			state.grapheme_count += 1;
-			state.bypass_next_rune = true;
-			UCG_DEFERRED_DECODE_STEP(); continue;
+	// "Do not break within emoji flag sequences.
+	//  That is, do not break between regional indicator (RI) symbols
+	//  if there is an odd number of RI characters before the break point."
+	//
+	// GB12:   sot (RI RI)* RI  ×  RI
+	// GB13: [^RI] (RI RI)* RI  ×  RI
+	if (this_gcb == UCG_GCB_REGIONAL_INDICATOR) {
+		if ((state->regional_indicator_counter & 1) == 0) {
+			state->grapheme_count += 1;
 		}
 
-		// _The GB9c rule only applies to extended grapheme clusters:_
-		// "Do not break within certain combinations with Indic_Conjunct_Break (InCB)=Linker."
+		state->current_sequence = UCG_SEQUENCE_REGIONAL;
+		state->continue_sequence = true;
+		state->regional_indicator_counter += 1;
+
+		return;
+	}
+
+	// "Otherwise, break everywhere."
+	//
+	// GB999: Any ÷ Any
+	state->grapheme_count += 1;
+}
+
+void _ucg_decode_grapheme_clusters_transition(
+	ucg_decoder_state* state,
+	ucg_properties this_properties
+) {
+	uint8_t next = ucg_gcb_dfa[state->dfa_state][ucg_gcb_dfa_classes[this_properties & UCG_GCB_DFA_CLASS_MASK]];
+
+	state->dfa_state = next & UCG_GCB_DFA_STATE_MASK;
+	if ((next & UCG_GCB_DFA_BREAK) != 0) {
+		state->grapheme_count += 1;
+	}
+}
+
+// After a rune of one of these classes, the decoder is in the same state no
+// matter what came before it. Decoding may be restarted from any such rune.
+static bool ucg_is_sync_rune(ucg_properties properties) {
+	return ((UCG_GCB_DFA_SYNC_CLASSES >> ucg_gcb_dfa_classes[properties & UCG_GCB_DFA_CLASS_MASK]) & 1) != 0;
+}
+
+// This decides whether `this_rune` begins a new grapheme with whichever engine
+// was selected at compile time.
+void _ucg_decode_grapheme_clusters_boundary(
+	ucg_decoder_state* state,
+	ucg_rune this_rune,
+	ucg_properties this_properties
+) {
+#if defined(UCG_RULE_CHAIN)
+	_ucg_decode_grapheme_clusters_rules(state, this_rune, this_properties);
+#else
+	(void)this_rune;
+	_ucg_decode_grapheme_clusters_transition(state, this_properties);
+#endif
+}
+
+// This runs the segmentation loop over `str` from `*byte_iterator` onwards,
+// carrying on from whatever `state` holds. It stops at the end of the string,
+// at the first rune that cannot be decoded, or at the first rune that would
+// begin a grapheme with no room left in `buffer`, leaving `*byte_iterator` at
+// the start of that rune.
+//
+// The string is read in code units of `unit_size` bytes, which is always a
+// constant, so that each encoding gets a loop of its own.
+static inline ucg_int ucg_decode_code_unit_range(
+	ucg_allocator* allocator,
+	ucg_grapheme_buffer* buffer,
+	ucg_decoder_state* state,
+	const void* str,
+	ucg_int unit_size,
+	ucg_int str_len,
+	ucg_int* byte_iterator
+) {
+	ucg_int byte_index = *byte_iterator;
+
+	ucg_rune_block block;
+	ucg_int block_index = 0;
+	block.length = 0;
+
+	while (byte_index < str_len) {
+		// (Optimization 3: Consume runs of printable ASCII in bulk.)
 		//
-		// GB9c: \p{InCB=Consonant} [ \p{InCB=Extend} \p{InCB=Linker} ]* \p{InCB=Linker} [ \p{InCB=Extend} \p{InCB=Linker} ]*  ×  \p{InCB=Consonant}
-		if (ucg_is_indic_conjunct_break_consonant(this_rune)) {
-			if (state.current_sequence == Indic) {
-				if (state.last_rune == ZERO_WIDTH_JOINER            ||
-				    ucg_is_indic_conjunct_break_linker(state.last_rune))
-				{
-					state.continue_sequence = true;
-				} else {
-					state.grapheme_count += 1;
+		// Unless the last rune was a Prepend character, each of these runes
+		// is a grapheme of its own, as in Optimization 1.
+		uint32_t unit = ucg_code_unit(str, unit_size, byte_index);
+		if (0x20 <= unit && unit <= 0x7E && _ucg_decode_grapheme_clusters_breaks_before_ascii(state)) {
+			ucg_int run = ucg_printable_ascii_code_unit_run(str, unit_size, str_len, byte_index);
+			if (buffer != NULL && run > ucg_grapheme_buffer_ascii_room(buffer)) {
+				run = ucg_grapheme_buffer_ascii_room(buffer);
+				if (run == 0) {
+					*byte_iterator = byte_index;
+					return UCG_BUFFER_FULL;
 				}
+			}
+			_ucg_decode_grapheme_clusters_ascii_run(allocator, buffer, state, str, unit_size, byte_index, run);
+			byte_index += run;
+
+			if (run < block.length - block_index) {
+				block_index += run;
 			} else {
-				state.grapheme_count += 1;
-				state.current_sequence = Indic;
-				state.continue_sequence = true;
+				block_index = block.length = 0;
 			}
-			UCG_DEFERRED_DECODE_STEP(); continue;
+			continue;
 		}
 
-		if (ucg_is_indic_conjunct_break_extend(this_rune)) {
-			if (state.current_sequence == Indic) {
-				if (ucg_is_indic_conjunct_break_consonant(state.last_rune) ||
-				    ucg_is_indic_conjunct_break_linker(state.last_rune))
-				{
-					state.continue_sequence = true;
-				} else {
-					state.grapheme_count += 1;
-				}
+		if (block_index == block.length) {
+			ucg_decode_code_unit_block(str, unit_size, str_len, byte_index, &block);
+			block_index = 0;
+
+			if (block.length == 0) {
+				// There was a Unicode parsing error; bail out.
+				*byte_iterator = byte_index;
+				return block.error;
 			}
-			UCG_DEFERRED_DECODE_STEP(); continue;
 		}
 
-		if (ucg_is_indic_conjunct_break_linker(this_rune)) {
-			if (state.current_sequence == Indic) {
-				if (ucg_is_indic_conjunct_break_extend(state.last_rune) ||
-				    ucg_is_indic_conjunct_break_linker(state.last_rune))
-				{
-					state.continue_sequence = true;
-				} else {
-					state.grapheme_count += 1;
-				}
+		if (buffer != NULL && ucg_grapheme_buffer_runes_full(buffer)) {
+			*byte_iterator = byte_index;
+			return UCG_BUFFER_FULL;
+		}
+
+		ucg_rune this_rune = (ucg_rune)block.runes[block_index];
+		ucg_properties this_properties = ucg_lookup_properties(this_rune);
+
+		if (buffer != NULL && ucg_grapheme_buffer_is_full(buffer, this_properties)) {
+			// With the buffer full, only runes that extend the last grapheme
+			// may go through. Whether this one does is only known after the
+			// rules have seen it, so they are run on a copy of the state.
+			ucg_decoder_state trial = *state;
+			_ucg_decode_grapheme_clusters_boundary(&trial, this_rune, this_properties);
+			if (state->rune_count == 0 || trial.grapheme_count > state->grapheme_count) {
+				*byte_iterator = byte_index;
+				return UCG_BUFFER_FULL;
 			}
-			UCG_DEFERRED_DECODE_STEP(); continue;
 		}
 
-		//
-		// (Curiously, there is no GB10.)
-		//
+		_ucg_decode_grapheme_clusters_boundary(state, this_rune, this_properties);
+		_ucg_decode_grapheme_clusters_deferred_step(allocator, buffer, state, byte_index, this_rune, this_properties);
 
-		// "Do not break within emoji modifier sequences or emoji zwj sequences."
-		//
-		// GB11: \p{Extended_Pictographic} Extend* ZWJ  ×  \p{Extended_Pictographic}
-		if (ucg_is_emoji_extended_pictographic(this_rune)) {
-			if (state.current_sequence != Emoji || state.last_rune != ZERO_WIDTH_JOINER) {
-				state.grapheme_count += 1;
+		byte_index += block.lengths[block_index];
+		block_index += 1;
+	}
+
+	*byte_iterator = byte_index;
+	return 0;
+}
+
+ucg_int _ucg_decode_grapheme_clusters_range(
+	ucg_allocator* allocator,
+	ucg_grapheme_buffer* buffer,
+	ucg_decoder_state* state,
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int* byte_iterator
+) {
+	return ucg_decode_code_unit_range(allocator, buffer, state, str, 1, str_len, byte_iterator);
+}
+
+// Counting runes alone needs nothing more than checking the UTF-8, which is
+// done in bulk where possible.
+static ucg_int ucg_count_runes(const uint8_t* str, ucg_int str_len, ucg_int* out_rune_count) {
+	ucg_int rune_count = 0;
+	ucg_int result = 0;
+
+	ucg_int byte_index = 0;
+	while (byte_index < str_len && result == 0) {
+		ucg_int valid_runes;
+		byte_index += ucg_valid_utf8_prefix(str + byte_index, str_len - byte_index, NULL, &valid_runes);
+		rune_count += valid_runes;
+
+		// Whatever stopped the fast path is decoded a rune at a time.
+		ucg_int block_end = byte_index + UCG_UTF8_BLOCK_SIZE;
+		while (byte_index < str_len && byte_index < block_end) {
+			ucg_rune this_rune = ucg_decode_rune(str, str_len, &byte_index);
+			if (this_rune < 0) {
+				result = (ucg_int)this_rune;
+				break;
 			}
-			state.current_sequence = Emoji;
-			state.continue_sequence = true;
-			UCG_DEFERRED_DECODE_STEP(); continue;
+			rune_count += 1;
 		}
+	}
 
-		// "Do not break within emoji flag sequences.
-		//  That is, do not break between regional indicator (RI) symbols
-		//  if there is an odd number of RI characters before the break point."
-		//
-		// GB12:   sot (RI RI)* RI  ×  RI
-		// GB13: [^RI] (RI RI)* RI  ×  RI
-		if (ucg_is_regional_indicator(this_rune)) {
-			if ((state.regional_indicator_counter & 1) == 0) {
-				state.grapheme_count += 1;
+	if (out_rune_count != NULL) { *out_rune_count = rune_count; }
+
+	return result;
+}
+
+ucg_int ucg_decode_runes(
+	const uint8_t* str,
+	ucg_int str_len,
+
+	uint32_t* out_runes,
+	ucg_int capacity,
+
+	ucg_int* out_consumed,
+	ucg_int* out_written
+) {
+	assert(str != NULL || str_len == 0);
+	assert(out_runes != NULL || capacity == 0);
+
+	ucg_int written = 0;
+	ucg_int result = 0;
+
+	ucg_int byte_index = 0;
+	while (byte_index < str_len && result == 0) {
+		// No rune is shorter than a byte, so checking no more bytes than there
+		// is room for runes keeps the fast path from overrunning the buffer.
+		ucg_int window = str_len - byte_index;
+		if (window > capacity - written) {
+			window = capacity - written;
+		}
+
+		ucg_int valid_runes;
+		byte_index += ucg_valid_utf8_prefix(str + byte_index, window, out_runes + written, &valid_runes);
+		written += valid_runes;
+
+		// Whatever stopped the fast path is decoded a rune at a time.
+		ucg_int block_end = byte_index + UCG_UTF8_BLOCK_SIZE;
+		while (byte_index < str_len && byte_index < block_end) {
+			if (written == capacity) {
+				result = UCG_BUFFER_FULL;
+				break;
+			}
+
+			if (str[byte_index] <= 0x7F) {
+				out_runes[written] = str[byte_index];
+				written += 1;
+				byte_index += 1;
+				continue;
+			}
+
+			ucg_int byte_iterator = byte_index;
+			ucg_rune this_rune = ucg_decode_rune(str, str_len, &byte_iterator);
+			if (this_rune < 0) {
+				result = (ucg_int)this_rune;
+				break;
+			}
+			out_runes[written] = (uint32_t)this_rune;
+			written += 1;
+			byte_index = byte_iterator;
+		}
+	}
+
+	if (out_consumed != NULL) { *out_consumed = byte_index; }
+	if (out_written != NULL)  { *out_written = written; }
+
+	return result;
+}
+
+#if !defined(UCG_RULE_CHAIN)
+// This is the segmentation loop for callers that only want the totals. With no
+// records to write, none of the bookkeeping in the decoder state is needed,
+// and the state machine is stepped on its own.
+//
+// It is instanced once per combination of `with_width`, which is always a
+// constant, so that counting alone never looks at a rune's width.
+static inline ucg_int ucg_count_range(
+	const uint8_t* str,
+	ucg_int str_len,
+	bool with_width,
+
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	uint8_t state = UCG_GCB_DFA_START;
+	ucg_int rune_count = 0;
+	ucg_int grapheme_count = 0;
+	ucg_int width = 0;
+	ucg_int result = 0;
+
+	ucg_rune_block block;
+	ucg_int block_index = 0;
+	block.length = 0;
+
+	ucg_int byte_index = 0;
+	while (byte_index < str_len) {
+		if (0x20 <= str[byte_index] && str[byte_index] <= 0x7E &&
+		    ucg_gcb_dfa[state][ucg_gcb_dfa_classes[UCG_GCB_OTHER]] == (UCG_GCB_DFA_BREAK | UCG_GCB_DFA_ASCII))
+		{
+			ucg_int run = ucg_printable_ascii_run(str + byte_index, str_len - byte_index);
+			byte_index += run;
+			rune_count += run;
+			grapheme_count += run;
+			if (with_width) {
+				width += run;
 			}
+			state = UCG_GCB_DFA_ASCII;
 
-			state.current_sequence = Regional;
-			state.continue_sequence = true;
-			state.regional_indicator_counter += 1;
+			if (run < block.length - block_index) {
+				block_index += run;
+			} else {
+				block_index = block.length = 0;
+			}
+			continue;
+		}
+
+		if (block_index == block.length) {
+			ucg_decode_rune_block(str, str_len, byte_index, &block);
+			block_index = 0;
 
-			UCG_DEFERRED_DECODE_STEP(); continue;
+			if (block.length == 0) {
+				result = block.error;
+				break;
+			}
 		}
 
-		// "Otherwise, break everywhere."
-		//
-		// GB999: Any ÷ Any
-		state.grapheme_count += 1;
-		UCG_DEFERRED_DECODE_STEP();
+		ucg_properties this_properties = ucg_lookup_properties((ucg_rune)block.runes[block_index]);
+		uint8_t next = ucg_gcb_dfa[state][ucg_gcb_dfa_classes[this_properties & UCG_GCB_DFA_CLASS_MASK]];
+		state = next & UCG_GCB_DFA_STATE_MASK;
+		if ((next & UCG_GCB_DFA_BREAK) != 0) {
+			grapheme_count += 1;
+			if (with_width) {
+				width += UCG_PROPERTY_WIDTH(this_properties);
+			}
+		}
+		rune_count += 1;
+
+		byte_index += block.lengths[block_index];
+		block_index += 1;
+	}
+
+	if (out_rune_count != NULL)     { *out_rune_count = rune_count; }
+	if (out_grapheme_count != NULL) { *out_grapheme_count = grapheme_count; }
+	if (out_width != NULL)          { *out_width = width; }
+
+	return result;
+}
+
+static ucg_int ucg_count_graphemes(const uint8_t* str, ucg_int str_len, ucg_int* out_rune_count, ucg_int* out_grapheme_count) {
+	return ucg_count_range(str, str_len, false, out_rune_count, out_grapheme_count, NULL);
+}
+
+static ucg_int ucg_count_graphemes_and_width(const uint8_t* str, ucg_int str_len, ucg_int* out_rune_count, ucg_int* out_grapheme_count, ucg_int* out_width) {
+	return ucg_count_range(str, str_len, true, out_rune_count, out_grapheme_count, out_width);
+}
+#endif
+
+ucg_int ucg_decode_grapheme_clusters(
+	ucg_allocator* allocator,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	ucg_grapheme** out_graphemes,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	// The following procedure implements text segmentation by breaking on
+	// Grapheme Cluster Boundaries[1], using the values[2] and rules[3] from
+	// the Unicode® Standard Annex #29, entitled:
+	//
+	// UNICODE TEXT SEGMENTATION
+	//
+	// Version:  Unicode 15.1.0
+	// Date:     2023-08-16
+	// Revision: 43
+	//
+	// This procedure is conformant[4] to UAX29-C1-1, otherwise known as the
+	// extended, non-legacy ruleset.
+	//
+	// Please see the references for more information.
+	//
+	//
+	// [1]: https://www.unicode.org/reports/tr29/#Grapheme_Cluster_Boundaries
+	// [2]: https://www.unicode.org/reports/tr29/#Default_Grapheme_Cluster_Table
+	// [3]: https://www.unicode.org/reports/tr29/#Grapheme_Cluster_Boundary_Rules
+	// [4]: https://www.unicode.org/reports/tr29/#Conformance
+
+	// Additionally, this procedure takes into account Standard Annex #11,
+	// in order to estimate how visually wide the string will appear on a
+	// monospaced display. This can only ever be a rough guess, as this tends
+	// to be an implementation detail relating to which fonts are being used,
+	// how codepoints are interpreted and drawn, if codepoint sequences are
+	// interpreted correctly, and et cetera.
+	//
+	// For example, a program may not properly interpret an emoji modifier
+	// sequence and print the component glyphs instead of one whole glyph.
+	//
+	// See here for more information: https://www.unicode.org/reports/tr11/
+	//
+	// NOTE: There is no explicit mention of what to do with zero-width spaces
+	// as far as grapheme cluster segmentation goes, therefore this
+	// implementation may count and return graphemes with a `width` of zero.
+	//
+	// Treat them as any other space.
+	assert(allocator == NULL || out_graphemes != NULL);
+
+	// Without an allocator there are no records to build, so the counting
+	// loop that computes only what was asked for will do.
+	if (allocator == NULL) {
+		if (out_graphemes != NULL) { *out_graphemes = NULL; }
+
+		if (out_grapheme_count == NULL && out_width == NULL) {
+			return ucg_count_runes(str, str_len, out_rune_count);
+		}
+#if !defined(UCG_RULE_CHAIN)
+		if (out_width == NULL) {
+			return ucg_count_graphemes(str, str_len, out_rune_count, out_grapheme_count);
+		}
+		return ucg_count_graphemes_and_width(str, str_len, out_rune_count, out_grapheme_count, out_width);
+#endif
 	}
 
-#undef UCG_DEFERRED_DECODE_STEP
+	ucg_decoder_state state = {0};
+
+	ucg_int byte_index = 0;
+	ucg_int result = _ucg_decode_grapheme_clusters_range(allocator, NULL, &state, str, str_len, &byte_index);
 
 	if (out_graphemes != NULL)      { *out_graphemes = state.graphemes; }
 	if (out_rune_count != NULL)     { *out_rune_count = state.rune_count; }
 	if (out_grapheme_count != NULL) { *out_grapheme_count = state.grapheme_count; }
 	if (out_width != NULL)          { *out_width = state.width; }
 
-	return 0;
+	return result;
+}
+
+static ucg_int ucg_decode_grapheme_clusters_code_units(
+	ucg_allocator* allocator,
+	const void* str,
+	ucg_int unit_size,
+	ucg_int str_len,
+
+	ucg_grapheme** out_graphemes,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	assert(allocator == NULL || out_graphemes != NULL);
+	assert(str != NULL || str_len == 0);
+
+	ucg_decoder_state state = {0};
+
+	ucg_int unit_index = 0;
+	ucg_int result = ucg_decode_code_unit_range(allocator, NULL, &state, str, unit_size, str_len, &unit_index);
+
+	if (out_graphemes != NULL)      { *out_graphemes = state.graphemes; }
+	if (out_rune_count != NULL)     { *out_rune_count = state.rune_count; }
+	if (out_grapheme_count != NULL) { *out_grapheme_count = state.grapheme_count; }
+	if (out_width != NULL)          { *out_width = state.width; }
+
+	return result;
+}
+
+ucg_int ucg_decode_grapheme_clusters_utf16(
+	ucg_allocator* allocator,
+	const uint16_t* str,
+	ucg_int str_len,
+
+	ucg_grapheme** out_graphemes,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	return ucg_decode_grapheme_clusters_code_units(allocator, str, 2, str_len, out_graphemes, out_rune_count, out_grapheme_count, out_width);
+}
+
+ucg_int ucg_decode_grapheme_clusters_utf32(
+	ucg_allocator* allocator,
+	const uint32_t* str,
+	ucg_int str_len,
+
+	ucg_grapheme** out_graphemes,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	return ucg_decode_grapheme_clusters_code_units(allocator, str, 4, str_len, out_graphemes, out_rune_count, out_grapheme_count, out_width);
+}
+
+void ucg_iterator_init(ucg_iterator* it, const uint8_t* str, ucg_int str_len) {
+	assert(it != NULL);
+	assert(str != NULL || str_len == 0);
+
+	memset(it, 0, sizeof(*it));
+	it->str = str;
+	it->str_len = str_len;
+}
+
+ucg_int ucg_iterator_next(ucg_iterator* it, ucg_grapheme_span* out_grapheme) {
+	assert(it != NULL);
+	assert(out_grapheme != NULL);
+
+	// A grapheme is only known to be complete once the rune after it begins
+	// another one, so the current grapheme is held in `pending` until then.
+	while (it->error == 0 && it->byte_index < it->str_len) {
+		ucg_int byte_index = it->byte_index;
+		ucg_rune this_rune = ucg_decode_rune(it->str, it->str_len, &it->byte_index);
+		if (this_rune < 0) {
+			it->error = this_rune;
+			it->byte_index = byte_index;
+			break;
+		}
+
+		ucg_properties this_properties = ucg_lookup_properties(this_rune);
+		ucg_int grapheme_count = it->state.grapheme_count;
+		ucg_int width = it->state.width;
+
+		_ucg_decode_grapheme_clusters_boundary(&it->state, this_rune, this_properties);
+		_ucg_decode_grapheme_clusters_deferred_step(NULL, NULL, &it->state, byte_index, this_rune, this_properties);
+
+		if (it->state.grapheme_count > grapheme_count) {
+			ucg_grapheme_span previous = it->pending;
+
+			it->pending.byte_index = byte_index;
+			it->pending.byte_length = it->byte_index - byte_index;
+			it->pending.rune_count = 1;
+			it->pending.width = it->state.width - width;
+
+			if (previous.rune_count > 0) {
+				*out_grapheme = previous;
+				return 0;
+			}
+		} else {
+			it->pending.byte_length = it->byte_index - it->pending.byte_index;
+			it->pending.rune_count += 1;
+		}
+	}
+
+	if (it->pending.rune_count > 0) {
+		*out_grapheme = it->pending;
+		it->pending.rune_count = 0;
+		return 0;
+	}
+
+	return it->error != 0 ? it->error : UCG_EOF;
+}
+
+void ucg_stream_init(ucg_stream* stream) {
+	assert(stream != NULL);
+
+	memset(stream, 0, sizeof(*stream));
+}
+
+ucg_int ucg_stream_feed(ucg_stream* stream, const uint8_t* chunk, ucg_int chunk_len) {
+	assert(stream != NULL);
+	assert(chunk != NULL || chunk_len == 0);
+
+	if (stream->error != 0 || chunk_len == 0) {
+		return stream->error;
+	}
+
+	ucg_int byte_index = 0;
+
+	// Finish the rune that was split by the end of the last chunk. No
+	// sequence is longer than 4 bytes, so the decoder sees as much of it
+	// here as it would have in one contiguous string.
+	if (stream->partial_len > 0) {
+		uint8_t buffer[4];
+		ucg_int taken = chunk_len < 4 - stream->partial_len ? chunk_len : 4 - stream->partial_len;
+		memcpy(buffer, stream->partial, stream->partial_len);
+		memcpy(buffer + stream->partial_len, chunk, taken);
+
+		ucg_int buffer_index = 0;
+		ucg_rune this_rune = ucg_decode_rune(buffer, stream->partial_len + taken, &buffer_index);
+
+		if (this_rune == UCG_EXPECTED_MORE_BYTES) {
+			assert(taken == chunk_len);
+			memcpy(stream->partial + stream->partial_len, chunk, taken);
+			stream->partial_len += taken;
+			return 0;
+		}
+
+		if (this_rune < 0) {
+			stream->error = this_rune;
+			return this_rune;
+		}
+
+		ucg_properties this_properties = ucg_lookup_properties(this_rune);
+		_ucg_decode_grapheme_clusters_boundary(&stream->state, this_rune, this_properties);
+		_ucg_decode_grapheme_clusters_deferred_step(NULL, NULL, &stream->state, 0, this_rune, this_properties);
+
+		byte_index = buffer_index - stream->partial_len;
+		stream->partial_len = 0;
+	}
+
+	ucg_int result = _ucg_decode_grapheme_clusters_range(NULL, NULL, &stream->state, chunk, chunk_len, &byte_index);
+
+	if (result == UCG_EXPECTED_MORE_BYTES) {
+		// The chunk ended in the middle of a rune; keep the bytes around for
+		// the next one.
+		assert(chunk_len - byte_index < 4);
+		stream->partial_len = chunk_len - byte_index;
+		memcpy(stream->partial, chunk + byte_index, stream->partial_len);
+		return 0;
+	}
+
+	stream->error = result;
+	return result;
+}
+
+ucg_int ucg_stream_finish(
+	ucg_stream* stream,
+
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	assert(stream != NULL);
+
+	if (stream->error == 0 && stream->partial_len > 0) {
+		stream->error = UCG_EXPECTED_MORE_BYTES;
+	}
+
+	if (out_rune_count != NULL)     { *out_rune_count = stream->state.rune_count; }
+	if (out_grapheme_count != NULL) { *out_grapheme_count = stream->state.grapheme_count; }
+	if (out_width != NULL)          { *out_width = stream->state.width; }
+
+	return stream->error;
+}
+
+void ucg_cursor_init(ucg_cursor* cursor) {
+	assert(cursor != NULL);
+
+	memset(cursor, 0, sizeof(*cursor));
+}
+
+ucg_int ucg_decode_grapheme_clusters_into(
+	ucg_cursor* cursor,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	ucg_grapheme* out_graphemes,
+	ucg_int capacity,
+	ucg_int* out_written,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	assert(cursor != NULL);
+	assert(out_graphemes != NULL || capacity == 0);
+	assert(capacity >= 0);
+	assert(cursor->byte_index <= str_len);
+
+	ucg_grapheme_buffer buffer;
+	ucg_grapheme_buffer_init(&buffer, capacity);
+	buffer.graphemes = out_graphemes;
+
+	ucg_int result = _ucg_decode_grapheme_clusters_range(NULL, &buffer, &cursor->state, str, str_len, &cursor->byte_index);
+
+	if (out_written != NULL)        { *out_written = buffer.length; }
+	if (out_rune_count != NULL)     { *out_rune_count = cursor->state.rune_count; }
+	if (out_grapheme_count != NULL) { *out_grapheme_count = cursor->state.grapheme_count; }
+	if (out_width != NULL)          { *out_width = cursor->state.width; }
+
+	return result;
+}
+
+ucg_int ucg_decode_grapheme_columns(
+	ucg_cursor* cursor,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	const ucg_grapheme_columns* columns,
+	ucg_int capacity,
+	ucg_int* out_written,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	assert(cursor != NULL);
+	assert(columns != NULL);
+	assert(capacity >= 0);
+	assert((uint64_t)str_len <= UINT32_MAX);
+	assert(cursor->byte_index <= str_len);
+	assert(!(columns->fields & UCG_FIELD_BYTE_INDEX)  || columns->byte_indices != NULL);
+	assert(!(columns->fields & UCG_FIELD_RUNE_INDEX)  || columns->rune_indices != NULL);
+	assert(!(columns->fields & UCG_FIELD_WIDTH)       || columns->widths != NULL);
+	assert(!(columns->fields & UCG_FIELD_UTF16_INDEX) || columns->utf16_indices != NULL);
+
+	ucg_grapheme_buffer buffer;
+	ucg_grapheme_buffer_init(&buffer, capacity);
+	buffer.columns = columns;
+
+	ucg_int result = _ucg_decode_grapheme_clusters_range(NULL, &buffer, &cursor->state, str, str_len, &cursor->byte_index);
+
+	if (out_written != NULL)        { *out_written = buffer.length; }
+	if (out_rune_count != NULL)     { *out_rune_count = cursor->state.rune_count; }
+	if (out_grapheme_count != NULL) { *out_grapheme_count = cursor->state.grapheme_count; }
+	if (out_width != NULL)          { *out_width = cursor->state.width; }
+
+	return result;
+}
+
+ucg_int ucg_decode_runes_and_graphemes(
+	ucg_cursor* cursor,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	uint32_t* out_runes,
+	ucg_int rune_capacity,
+	ucg_int* out_runes_written,
+
+	const ucg_grapheme_columns* columns,
+	ucg_int capacity,
+	ucg_int* out_written,
+
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	assert(cursor != NULL);
+	assert(out_runes != NULL);
+	assert(rune_capacity >= 0);
+	assert(columns != NULL);
+	assert(capacity >= 0);
+	assert((uint64_t)str_len <= UINT32_MAX);
+	assert(cursor->byte_index <= str_len);
+	assert(!(columns->fields & UCG_FIELD_BYTE_INDEX)  || columns->byte_indices != NULL);
+	assert(!(columns->fields & UCG_FIELD_RUNE_INDEX)  || columns->rune_indices != NULL);
+	assert(!(columns->fields & UCG_FIELD_WIDTH)       || columns->widths != NULL);
+	assert(!(columns->fields & UCG_FIELD_UTF16_INDEX) || columns->utf16_indices != NULL);
+
+	ucg_grapheme_buffer buffer;
+	ucg_grapheme_buffer_init(&buffer, capacity);
+	buffer.columns = columns;
+	buffer.runes = out_runes;
+	buffer.rune_capacity = rune_capacity;
+
+	ucg_int result = _ucg_decode_grapheme_clusters_range(NULL, &buffer, &cursor->state, str, str_len, &cursor->byte_index);
+
+	if (out_runes_written != NULL)  { *out_runes_written = buffer.rune_length; }
+	if (out_written != NULL)        { *out_written = buffer.length; }
+	if (out_rune_count != NULL)     { *out_rune_count = cursor->state.rune_count; }
+	if (out_grapheme_count != NULL) { *out_grapheme_count = cursor->state.grapheme_count; }
+	if (out_width != NULL)          { *out_width = cursor->state.width; }
+
+	return result;
+}
+
+ucg_int ucg_decode_grapheme_boundaries(
+	const uint8_t* str,
+	ucg_int str_len,
+
+	uint8_t* out_boundaries,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	assert(out_boundaries != NULL || str_len == 0);
+
+	if (str_len > 0) {
+		memset(out_boundaries, 0, (size_t)((str_len + 7) >> 3));
+	}
+
+	// Every grapheme is at least one byte long, so the bitmap can never fill.
+	ucg_grapheme_buffer buffer;
+	ucg_grapheme_buffer_init(&buffer, str_len);
+	buffer.boundaries = out_boundaries;
+
+	ucg_decoder_state state = {0};
+	ucg_int byte_index = 0;
+	ucg_int result = _ucg_decode_grapheme_clusters_range(NULL, &buffer, &state, str, str_len, &byte_index);
+
+	if (out_rune_count != NULL)     { *out_rune_count = state.rune_count; }
+	if (out_grapheme_count != NULL) { *out_grapheme_count = state.grapheme_count; }
+	if (out_width != NULL)          { *out_width = state.width; }
+
+	return result;
+}
+
+// This decodes the rune that ends at `end`, storing where it starts in
+// `out_start`.
+static ucg_rune ucg_decode_last_rune(const uint8_t* str, ucg_int end, ucg_int* out_start) {
+	assert(end > 0);
+
+	ucg_int start = end - 1;
+	while (start > 0 && end - start < 4 && (str[start] & 0xC0) == 0x80) {
+		start -= 1;
+	}
+
+	ucg_int byte_index = start;
+	ucg_rune r = ucg_decode_rune(str, end, &byte_index);
+	if (r < 0) {
+		return r;
+	}
+	if (byte_index != end) {
+		return UCG_INVALID_RUNE;
+	}
+
+	*out_start = start;
+	return r;
+}
+
+// This moves every state in the set `states`, one bit per state, on a rune of
+// the given properties. `out_breaks` is set if any of them begin a grapheme
+// with it, and `out_joins` if any of them do not.
+static uint32_t ucg_transition_state_set(uint32_t states, ucg_properties properties, bool* out_breaks, bool* out_joins) {
+	uint8_t class_index = ucg_gcb_dfa_classes[properties & UCG_GCB_DFA_CLASS_MASK];
+	uint32_t next_states = 0;
+	*out_breaks = false;
+	*out_joins = false;
+
+	for (ucg_int i = 0; i < UCG_GCB_DFA_STATE_COUNT; i += 1) {
+		if ((states >> i) & 1) {
+			uint8_t next = ucg_gcb_dfa[i][class_index];
+			next_states |= (uint32_t)1 << (next & UCG_GCB_DFA_STATE_MASK);
+			if ((next & UCG_GCB_DFA_BREAK) != 0) {
+				*out_breaks = true;
+			} else {
+				*out_joins = true;
+			}
+		}
+	}
+	return next_states;
+}
+
+// Reading back this many runes is usually enough to settle a boundary.
+#define UCG_LOOKBACK_RUNES 8
+
+// This finds where the last grapheme that begins before `end` begins. `end`
+// must be the start of a rune, past the start of the string.
+//
+// The state of the machine in the middle of text is not known without reading
+// all of the text before it, so the machine is instead run from a few runes
+// back in every state it could be in, which is enough as long as they all
+// agree on where graphemes begin. Only when they do not, such as in a run of
+// regional indicators, is more of the text read, twice as much each time, or
+// up to the nearest rune after which the state is known.
+//
+// This always steps the machine, whichever engine decodes forwards.
+static ucg_int ucg_last_boundary_before(const uint8_t* str, ucg_int end) {
+	assert(end > 0);
+
+	ucg_int start = end;
+	ucg_int lookback = UCG_LOOKBACK_RUNES;
+	for (;;) {
+		bool synced = false;
+		for (ucg_int i = 0; i < lookback && start > 0 && !synced; i += 1) {
+			ucg_int rune_start;
+			ucg_rune this_rune = ucg_decode_last_rune(str, start, &rune_start);
+			if (this_rune < 0) {
+				return this_rune;
+			}
+			synced = ucg_is_sync_rune(ucg_lookup_properties(this_rune));
+			start = rune_start;
+		}
+
+		uint32_t states = start == 0 ? (uint32_t)1 << UCG_GCB_DFA_START : UCG_GCB_DFA_RESUME_STATES;
+		ucg_int boundary = -1;
+		bool unsettled = false;
+		for (ucg_int byte_index = start; byte_index < end; /**/) {
+			ucg_int rune_start = byte_index;
+			ucg_rune this_rune = ucg_decode_rune(str, end, &byte_index);
+			if (this_rune < 0) {
+				return this_rune;
+			}
+
+			bool breaks, joins;
+			states = ucg_transition_state_set(states, ucg_lookup_properties(this_rune), &breaks, &joins);
+			if (breaks && !joins) {
+				boundary = rune_start;
+				unsettled = false;
+			} else if (breaks) {
+				unsettled = true;
+			}
+		}
+
+		if (!unsettled) {
+			if (boundary >= 0) {
+				return boundary;
+			}
+
+			// None of these runes begin a grapheme, so the one we are
+			// looking for is further back. The string always begins with a
+			// grapheme, so this cannot happen once `start` reaches 0.
+			assert(start > 0);
+			end = start;
+			lookback = UCG_LOOKBACK_RUNES;
+		} else {
+			lookback *= 2;
+		}
+	}
+}
+
+ucg_int ucg_prev_grapheme_boundary(const uint8_t* str, ucg_int str_len, ucg_int offset) {
+	assert(str != NULL || str_len == 0);
+	assert(0 <= offset && offset <= str_len);
+
+	// There is no boundary inside of a rune, so an offset in the middle of
+	// one has the same answer as the offset just past it.
+	while (offset < str_len && (str[offset] & 0xC0) == 0x80) {
+		offset += 1;
+	}
+
+	if (offset == 0) {
+		return UCG_EOF;
+	}
+
+	return ucg_last_boundary_before(str, offset);
+}
+
+ucg_int ucg_find_boundary_at(const uint8_t* str, ucg_int str_len, ucg_int offset) {
+	assert(str != NULL || str_len == 0);
+	assert(0 <= offset && offset <= str_len);
+
+	if (offset == str_len) {
+		return UCG_EOF;
+	}
+
+	// The grapheme that contains `offset` is the last one to begin before
+	// the end of the rune that the offset falls in.
+	ucg_int end = offset + 1;
+	while (end < str_len && (str[end] & 0xC0) == 0x80) {
+		end += 1;
+	}
+	return ucg_last_boundary_before(str, end);
+}
+
+void ucg_reverse_iterator_init(ucg_reverse_iterator* it, const uint8_t* str, ucg_int str_len) {
+	assert(it != NULL);
+	assert(str != NULL || str_len == 0);
+
+	it->str = str;
+	it->str_len = str_len;
+	it->byte_index = str_len;
+}
+
+ucg_int ucg_reverse_iterator_prev(ucg_reverse_iterator* it, ucg_grapheme_span* out_grapheme) {
+	assert(it != NULL);
+	assert(out_grapheme != NULL);
+
+	ucg_int end = it->byte_index;
+	ucg_int start = ucg_prev_grapheme_boundary(it->str, it->str_len, end);
+	if (start < 0) {
+		return start;
+	}
+
+	ucg_grapheme_span span = {start, end - start, 0, 0};
+	for (ucg_int byte_index = start; byte_index < end; /**/) {
+		ucg_rune this_rune = ucg_decode_rune(it->str, end, &byte_index);
+		if (span.rune_count == 0) {
+			span.width = UCG_PROPERTY_WIDTH(ucg_lookup_properties(this_rune));
+		}
+		span.rune_count += 1;
+	}
+
+	it->byte_index = start;
+	*out_grapheme = span;
+	return 0;
+}
+
+// This returns true if no rune that begins in the 3 bytes before `byte_index`
+// can reach past it, so that a rune begins there however the text before it
+// was decoded.
+static bool ucg_is_rune_start(const uint8_t* str, ucg_int byte_index) {
+	for (ucg_int i = byte_index > 3 ? byte_index - 3 : 0; i < byte_index; i += 1) {
+		ucg_int length = str[i] >= 0xF0 ? 4 : str[i] >= 0xE0 ? 3 : str[i] >= 0xC0 ? 2 : 1;
+		if (i + length > byte_index) {
+			return false;
+		}
+	}
+	return true;
+}
+
+typedef struct {
+	const uint8_t* str;
+	ucg_int start;
+	ucg_int end;
+
+	// Where the rune that the decoder resumes after begins, or -1 if this
+	// piece starts at the beginning of the string.
+	ucg_int sync_start;
+
+	// The counts of all the text before this piece, and where its graphemes
+	// go, if they are wanted.
+	ucg_int rune_base;
+	ucg_int grapheme_base;
+	ucg_int width_base;
+	ucg_grapheme* graphemes;
+
+	ucg_int result;
+	ucg_int rune_count;
+	ucg_int grapheme_count;
+	ucg_int width;
+} ucg_parallel_piece;
+
+static void ucg_segment_piece(ucg_parallel_piece* piece) {
+	ucg_decoder_state state = {0};
+
+	if (piece->sync_start >= 0) {
+		ucg_int byte_index = piece->sync_start;
+		ucg_rune this_rune = ucg_decode_rune(piece->str, piece->start, &byte_index);
+		ucg_properties this_properties = ucg_lookup_properties(this_rune);
+
+		_ucg_decode_grapheme_clusters_boundary(&state, this_rune, this_properties);
+		_ucg_decode_grapheme_clusters_deferred_step(NULL, NULL, &state, piece->sync_start, this_rune, this_properties);
+
+		// Carry on from the counts before this piece, so that GB1 does not
+		// apply and the graphemes are numbered as they are in one pass.
+		state.rune_count = piece->rune_base;
+		state.grapheme_count = piece->grapheme_base;
+		state.width = piece->width_base;
+		state.last_grapheme_count = state.grapheme_count;
+		state.last_width = state.width;
+	}
+
+	ucg_grapheme_buffer buffer;
+	ucg_grapheme_buffer_init(&buffer, piece->grapheme_count);
+	buffer.graphemes = piece->graphemes;
+
+	ucg_int byte_index = piece->start;
+	piece->result = _ucg_decode_grapheme_clusters_range(NULL, piece->graphemes != NULL ? &buffer : NULL, &state, piece->str, piece->end, &byte_index);
+
+	piece->rune_count = state.rune_count - piece->rune_base;
+	piece->grapheme_count = state.grapheme_count - piece->grapheme_base;
+	piece->width = state.width - piece->width_base;
+}
+
+#if !defined(UCG_NO_THREADS)
+#  if defined(_WIN32)
+static DWORD WINAPI ucg_segment_piece_thread(LPVOID piece) {
+	ucg_segment_piece((ucg_parallel_piece*)piece);
+	return 0;
+}
+#  else
+static void* ucg_segment_piece_thread(void* piece) {
+	ucg_segment_piece((ucg_parallel_piece*)piece);
+	return NULL;
+}
+#  endif
+#endif
+
+// This segments every piece, the first on the calling thread and the rest on
+// threads of their own. A piece whose thread cannot be started is segmented on
+// the calling thread instead.
+static void ucg_segment_pieces(ucg_parallel_piece* pieces, ucg_int piece_count) {
+#if defined(UCG_NO_THREADS)
+	for (ucg_int i = 0; i < piece_count; i += 1) {
+		ucg_segment_piece(&pieces[i]);
+	}
+#else
+#  if defined(_WIN32)
+	HANDLE threads[UCG_PARALLEL_MAX_THREADS];
+	for (ucg_int i = 1; i < piece_count; i += 1) {
+		threads[i] = CreateThread(NULL, 0, ucg_segment_piece_thread, &pieces[i], 0, NULL);
+	}
+	ucg_segment_piece(&pieces[0]);
+	for (ucg_int i = 1; i < piece_count; i += 1) {
+		if (threads[i] != NULL) {
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		} else {
+			ucg_segment_piece(&pieces[i]);
+		}
+	}
+#  else
+	pthread_t threads[UCG_PARALLEL_MAX_THREADS];
+	bool started[UCG_PARALLEL_MAX_THREADS];
+	for (ucg_int i = 1; i < piece_count; i += 1) {
+		started[i] = pthread_create(&threads[i], NULL, ucg_segment_piece_thread, &pieces[i]) == 0;
+	}
+	ucg_segment_piece(&pieces[0]);
+	for (ucg_int i = 1; i < piece_count; i += 1) {
+		if (started[i]) {
+			pthread_join(threads[i], NULL);
+		} else {
+			ucg_segment_piece(&pieces[i]);
+		}
+	}
+#  endif
+#endif
+}
+
+// This looks backwards from `guess` for a rune after which decoding can be
+// resumed, returning where it begins, or -1 if there is none close by.
+static ucg_int ucg_find_sync_rune(const uint8_t* str, ucg_int floor, ucg_int guess) {
+	ucg_int end = guess;
+	while (end > floor && guess - end < 4 && ((str[end] & 0xC0) == 0x80 || !ucg_is_rune_start(str, end))) {
+		end -= 1;
+	}
+
+	while (end > floor && guess - end < UCG_PARALLEL_SYNC_WINDOW) {
+		ucg_int start;
+		ucg_rune r = ucg_decode_last_rune(str, end, &start);
+		if (r < 0 || start < floor) {
+			return -1;
+		}
+		if (ucg_is_sync_rune(ucg_lookup_properties(r)) &&
+		    ucg_is_rune_start(str, start) &&
+		    ucg_is_rune_start(str, end))
+		{
+			return start;
+		}
+		end = start;
+	}
+	return -1;
+}
+
+ucg_int ucg_decode_grapheme_clusters_parallel(
+	ucg_allocator* allocator,
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int thread_count,
+
+	ucg_grapheme** out_graphemes,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	assert(allocator == NULL || out_graphemes != NULL);
+
+	if (thread_count > str_len / UCG_PARALLEL_MIN_BYTES) {
+		thread_count = str_len / UCG_PARALLEL_MIN_BYTES;
+	}
+	if (thread_count > UCG_PARALLEL_MAX_THREADS) {
+		thread_count = UCG_PARALLEL_MAX_THREADS;
+	}
+#if defined(UCG_NO_THREADS)
+	thread_count = 1;
+#endif
+	if (thread_count <= 1) {
+		return ucg_decode_grapheme_clusters(allocator, str, str_len, out_graphemes, out_rune_count, out_grapheme_count, out_width);
+	}
+
+	// Split the string into roughly even pieces, each starting just after a
+	// rune that leaves the decoder in a known state. Where there is no such
+	// rune nearby, the neighbouring pieces are joined.
+	ucg_parallel_piece pieces[UCG_PARALLEL_MAX_THREADS];
+	ucg_int piece_count = 0;
+	ucg_int start = 0;
+	ucg_int sync_start = -1;
+
+	for (ucg_int i = 1; i <= thread_count; i += 1) {
+		ucg_int end = str_len;
+		ucg_int next_sync_start = -1;
+
+		if (i < thread_count) {
+			next_sync_start = ucg_find_sync_rune(str, start, (ucg_int)((int64_t)str_len * i / thread_count));
+			if (next_sync_start < 0) {
+				continue;
+			}
+			end = next_sync_start;
+			ucg_decode_rune(str, str_len, &end);
+		}
+
+		// For now, the counts only need to keep GB1 from applying again.
+		ucg_int base = sync_start >= 0 ? 1 : 0;
+		ucg_parallel_piece piece = {str, start, end, sync_start, base, base, 0, NULL, 0, 0, 0, 0};
+		pieces[piece_count] = piece;
+		piece_count += 1;
+
+		start = end;
+		sync_start = next_sync_start;
+	}
+
+	ucg_segment_pieces(pieces, piece_count);
+
+	// Add up the pieces, stopping at the first one that failed to parse, as
+	// one pass would have stopped there.
+	ucg_int result = 0;
+	ucg_int rune_count = 0;
+	ucg_int grapheme_count = 0;
+	ucg_int width = 0;
+	ucg_int used_pieces = 0;
+
+	for (/**/; used_pieces < piece_count && result == 0; used_pieces += 1) {
+		pieces[used_pieces].rune_base = rune_count;
+		pieces[used_pieces].grapheme_base = grapheme_count;
+		pieces[used_pieces].width_base = width;
+
+		result = pieces[used_pieces].result;
+		rune_count += pieces[used_pieces].rune_count;
+		grapheme_count += pieces[used_pieces].grapheme_count;
+		width += pieces[used_pieces].width;
+	}
+
+	if (allocator != NULL) {
+		// With the counts known, the graphemes are allocated once and each
+		// piece fills in its own part of the array.
+		ucg_grapheme* graphemes = (ucg_grapheme*)allocator->malloc(sizeof(ucg_grapheme) * (1 + grapheme_count), allocator->ctx);
+
+		for (ucg_int i = 0; i < used_pieces; i += 1) {
+			pieces[i].graphemes = graphemes + pieces[i].grapheme_base;
+		}
+		ucg_segment_pieces(pieces, used_pieces);
+
+		*out_graphemes = graphemes;
+	}
+
+	if (out_rune_count != NULL)     { *out_rune_count = rune_count; }
+	if (out_grapheme_count != NULL) { *out_grapheme_count = grapheme_count; }
+	if (out_width != NULL)          { *out_width = width; }
+
+	return result;
+}
+
+// A summary holds, for every state the machine may be in when it reaches a
+// piece of text, the state it leaves in and the graphemes and width it counts
+// along the way. Merging two summaries is then a matter of composing the two,
+// which is associative.
+//
+// The text is decoded from after any bytes that continue a rune from before
+// it, up to any rune that it leaves unfinished. Those are kept aside, so that
+// they can be joined up with the pieces on either side when merging.
+
+#if UCG_GCB_DFA_STATE_COUNT > UCG_SUMMARY_STATES
+#  error "UCG_SUMMARY_STATES is too small for the state machine."
+#endif
+
+static void ucg_summary_init(ucg_summary* summary) {
+	memset(summary, 0, sizeof(*summary));
+	for (ucg_int i = 0; i < UCG_GCB_DFA_STATE_COUNT; i += 1) {
+		summary->exit_state[i] = (uint8_t)i;
+	}
+}
+
+// This carries every entry of `summary` on over one more rune.
+static void ucg_summary_step(ucg_summary* summary, ucg_properties this_properties) {
+	const uint8_t class = ucg_gcb_dfa_classes[this_properties & UCG_GCB_DFA_CLASS_MASK];
+	const ucg_int width = UCG_PROPERTY_WIDTH(this_properties);
+
+	for (ucg_int i = 0; i < UCG_GCB_DFA_STATE_COUNT; i += 1) {
+		uint8_t next = ucg_gcb_dfa[summary->exit_state[i]][class];
+		summary->exit_state[i] = next & UCG_GCB_DFA_STATE_MASK;
+		if ((next & UCG_GCB_DFA_BREAK) != 0) {
+			summary->grapheme_count[i] += 1;
+			summary->width[i] += width;
+		}
+	}
+	summary->rune_count += 1;
+}
+
+// This carries every entry of `summary` on through the text of `next`.
+static void ucg_summary_compose(ucg_summary* summary, const ucg_summary* next) {
+	for (ucg_int i = 0; i < UCG_GCB_DFA_STATE_COUNT; i += 1) {
+		uint8_t middle = summary->exit_state[i];
+		summary->exit_state[i] = next->exit_state[middle];
+		summary->grapheme_count[i] += next->grapheme_count[middle];
+		summary->width[i] += next->width[middle];
+	}
+	summary->rune_count += next->rune_count;
+	summary->error = next->error;
+	memcpy(summary->tail, next->tail, sizeof(summary->tail));
+	summary->tail_length = next->tail_length;
+}
+
+void ucg_summarize(const uint8_t* str, ucg_int str_len, ucg_summary* out_summary) {
+	assert(str != NULL || str_len == 0);
+	assert(out_summary != NULL);
+
+	ucg_summary* summary = out_summary;
+	ucg_summary_init(summary);
+
+	summary->byte_count = str_len;
+	if (str_len > 0) {
+		memcpy(summary->head, str, str_len < 4 ? (size_t)str_len : 4);
+	}
+	while (summary->head_length < str_len && summary->head_length < 3 && (str[summary->head_length] & 0xC0) == 0x80) {
+		summary->head_length += 1;
+	}
+
+	// Every entry is stepped on its own until they have all been drawn into
+	// the same state, which usually takes a single rune. From there on, they
+	// only need to be stepped once between them.
+	bool converged = false;
+	uint8_t state = 0;
+	ucg_int grapheme_count = 0;
+	ucg_int width = 0;
+
+	ucg_int byte_index = summary->head_length;
+	while (byte_index < str_len) {
+		if (converged &&
+		    0x20 <= str[byte_index] && str[byte_index] <= 0x7E &&
+		    ucg_gcb_dfa[state][ucg_gcb_dfa_classes[UCG_GCB_OTHER]] == (UCG_GCB_DFA_BREAK | UCG_GCB_DFA_ASCII))
+		{
+			ucg_int run = ucg_printable_ascii_run(str + byte_index, str_len - byte_index);
+			byte_index += run;
+			summary->rune_count += run;
+			grapheme_count += run;
+			width += run;
+			state = UCG_GCB_DFA_ASCII;
+			continue;
+		}
+
+		ucg_int rune_start = byte_index;
+		ucg_rune this_rune = ucg_decode_rune(str, str_len, &byte_index);
+		if (this_rune == UCG_EXPECTED_MORE_BYTES) {
+			summary->tail_length = str_len - rune_start;
+			memcpy(summary->tail, str + rune_start, (size_t)summary->tail_length);
+			break;
+		} else if (this_rune < 0) {
+			summary->error = this_rune;
+			break;
+		}
+
+		ucg_properties this_properties = ucg_lookup_properties(this_rune);
+		if (converged) {
+			uint8_t next = ucg_gcb_dfa[state][ucg_gcb_dfa_classes[this_properties & UCG_GCB_DFA_CLASS_MASK]];
+			state = next & UCG_GCB_DFA_STATE_MASK;
+			if ((next & UCG_GCB_DFA_BREAK) != 0) {
+				grapheme_count += 1;
+				width += UCG_PROPERTY_WIDTH(this_properties);
+			}
+			summary->rune_count += 1;
+		} else {
+			ucg_summary_step(summary, this_properties);
+
+			converged = true;
+			for (ucg_int i = 1; i < UCG_GCB_DFA_STATE_COUNT && converged; i += 1) {
+				converged = summary->exit_state[i] == summary->exit_state[0];
+			}
+			state = summary->exit_state[0];
+		}
+	}
+
+	if (converged) {
+		for (ucg_int i = 0; i < UCG_GCB_DFA_STATE_COUNT; i += 1) {
+			summary->exit_state[i] = state;
+			summary->grapheme_count[i] += grapheme_count;
+			summary->width[i] += width;
+		}
+	}
+}
+
+void ucg_summary_merge(const ucg_summary* a, const ucg_summary* b, ucg_summary* out_summary) {
+	assert(a != NULL);
+	assert(b != NULL);
+	assert(out_summary != NULL);
+
+	ucg_summary merged;
+
+	if (a->byte_count == 0) {
+		merged = *b;
+	} else if (b->byte_count == 0 || a->error != 0) {
+		merged = *a;
+	} else if (a->head_length == a->byte_count) {
+		// All of `a` continues a rune from before it, and so does the start of
+		// `b`. If that makes for more continuation bytes than any rune can
+		// have, the first of them that is left over cannot be decoded.
+		if (a->head_length + b->head_length <= 3) {
+			merged = *b;
+			merged.head_length = a->head_length + b->head_length;
+		} else {
+			ucg_summary_init(&merged);
+			merged.head_length = 3;
+			merged.error = UCG_INVALID_RUNE;
+		}
+	} else if (a->tail_length == 0) {
+		merged = *a;
+		if (b->head_length > 0) {
+			// There is no rune for the start of `b` to continue.
+			merged.error = UCG_INVALID_RUNE;
+		} else {
+			ucg_summary_compose(&merged, b);
+		}
+	} else {
+		merged = *a;
+		memset(merged.tail, 0, sizeof(merged.tail));
+		merged.tail_length = 0;
+
+		// Finish the rune that `a` left off with from the start of `b`.
+		uint8_t joined[8];
+		ucg_int joined_len = a->tail_length + (b->byte_count < 4 ? b->byte_count : 4);
+		memcpy(joined, a->tail, (size_t)a->tail_length);
+		memcpy(joined + a->tail_length, b->head, (size_t)(joined_len - a->tail_length));
+
+		ucg_int byte_index = 0;
+		ucg_rune this_rune = ucg_decode_rune(joined, joined_len, &byte_index);
+		if (this_rune == UCG_EXPECTED_MORE_BYTES) {
+			// `b` is too short to finish it, so it is still left unfinished.
+			memcpy(merged.tail, joined, (size_t)joined_len);
+			merged.tail_length = joined_len;
+		} else if (this_rune < 0) {
+			merged.error = this_rune;
+		} else {
+			ucg_summary_step(&merged, ucg_lookup_properties(this_rune));
+			if (byte_index - a->tail_length < b->head_length) {
+				merged.error = UCG_INVALID_RUNE;
+			} else {
+				ucg_summary_compose(&merged, b);
+			}
+		}
+	}
+
+	merged.byte_count = a->byte_count + b->byte_count;
+	if (a->byte_count < 4) {
+		memcpy(merged.head, a->head, sizeof(merged.head));
+		ucg_int from_b = 4 - a->byte_count;
+		memcpy(merged.head + a->byte_count, b->head, (size_t)(b->byte_count < from_b ? b->byte_count : from_b));
+	}
+
+	*out_summary = merged;
+}
+
+ucg_int ucg_summary_totals(
+	const ucg_summary* summary,
+
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	assert(summary != NULL);
+
+	ucg_int result = summary->error;
+	ucg_int rune_count = summary->rune_count;
+	ucg_int grapheme_count = summary->grapheme_count[UCG_GCB_DFA_START];
+	ucg_int width = summary->width[UCG_GCB_DFA_START];
+
+	if (summary->head_length > 0) {
+		// The string starts in the middle of a rune.
+		result = UCG_INVALID_RUNE;
+		rune_count = grapheme_count = width = 0;
+	} else if (result == 0 && summary->tail_length > 0) {
+		result = UCG_EXPECTED_MORE_BYTES;
+	}
+
+	if (out_rune_count != NULL)     { *out_rune_count = rune_count; }
+	if (out_grapheme_count != NULL) { *out_grapheme_count = grapheme_count; }
+	if (out_width != NULL)          { *out_width = width; }
+
+	return result;
+}
+
+ucg_int ucg_grapheme_count_batch(
+	const uint8_t* data,
+	const int32_t* offsets,
+	ucg_int string_count,
+
+	ucg_int* out_results,
+	ucg_int* out_rune_counts,
+	ucg_int* out_grapheme_counts,
+	ucg_int* out_widths
+) {
+	assert(offsets != NULL);
+	assert(data != NULL || string_count == 0 || offsets[string_count] == offsets[0]);
+
+	ucg_int failed = 0;
+
+	// Short strings are mostly plain ASCII, and a string of printable ASCII
+	// is as many graphemes as it is bytes. Runs of such bytes are scanned
+	// straight across the string boundaries, so that the vectorized scan is
+	// not cut short by every string, and any string that falls entirely in
+	// the last run scanned is counted without decoding it at all.
+	ucg_int data_end = string_count > 0 ? offsets[string_count] : 0;
+	ucg_int ascii_start = 0;
+	ucg_int ascii_end = 0;
+
+	for (ucg_int i = 0; i < string_count; i += 1) {
+		ucg_int start = offsets[i];
+		ucg_int end = offsets[i + 1];
+		assert(0 <= start && start <= end && end <= data_end);
+
+		if (start >= ascii_end && start < data_end) {
+			ascii_start = start;
+			ascii_end = start + ucg_printable_ascii_run(data + start, data_end - start);
+		}
+
+		ucg_int result = 0;
+		ucg_int rune_count, grapheme_count, width;
+
+		if (ascii_start <= start && end <= ascii_end) {
+			rune_count = grapheme_count = width = end - start;
+		} else {
+			ucg_decoder_state state = {0};
+			ucg_int byte_index = 0;
+			result = _ucg_decode_grapheme_clusters_range(NULL, NULL, &state, data + start, end - start, &byte_index);
+
+			rune_count = state.rune_count;
+			grapheme_count = state.grapheme_count;
+			width = state.width;
+			if (result != 0) {
+				failed += 1;
+			}
+		}
+
+		if (out_results != NULL)         { out_results[i] = result; }
+		if (out_rune_counts != NULL)     { out_rune_counts[i] = rune_count; }
+		if (out_grapheme_counts != NULL) { out_grapheme_counts[i] = grapheme_count; }
+		if (out_widths != NULL)          { out_widths[i] = width; }
+	}
+
+	return failed;
+}
+
+ucg_int ucg_truncate_to_width(
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int max_width,
+	ucg_int ellipsis_width,
+
+	ucg_int* out_byte_length,
+	ucg_int* out_width
+) {
+	assert(str != NULL || str_len == 0);
+	assert(max_width >= 0);
+	assert(ellipsis_width >= 0);
+
+	// The width of a grapheme is known as soon as it begins, so graphemes are
+	// taken a few at a time and the string is read no further than the first
+	// one that does not fit.
+	ucg_grapheme graphemes[64];
+	ucg_grapheme_buffer buffer;
+	ucg_grapheme_buffer_init(&buffer, sizeof(graphemes) / sizeof(graphemes[0]));
+	buffer.graphemes = graphemes;
+
+	ucg_decoder_state state = {0};
+	ucg_int byte_index = 0;
+
+	// This is where the string is cut if it turns out to be too wide, which
+	// is the longest run of graphemes that leaves room for the ellipsis.
+	ucg_int cut_width_limit = max_width - ellipsis_width;
+	ucg_int cut_byte_length = -1;
+	ucg_int cut_width = 0;
+
+	ucg_int width = 0;
+	ucg_int result;
+
+	do {
+		buffer.length = 0;
+		result = _ucg_decode_grapheme_clusters_range(NULL, &buffer, &state, str, str_len, &byte_index);
+
+		for (ucg_int i = 0; i < buffer.length; i += 1) {
+			if (cut_byte_length < 0 && width + graphemes[i].width > cut_width_limit) {
+				cut_byte_length = graphemes[i].byte_index;
+				cut_width = width;
+			}
+			if (width + graphemes[i].width > max_width) {
+				if (out_byte_length != NULL) { *out_byte_length = cut_byte_length; }
+				if (out_width != NULL)       { *out_width = cut_width; }
+				return 0;
+			}
+			width += graphemes[i].width;
+		}
+	} while (result == UCG_BUFFER_FULL);
+
+	// The whole string fits, or as much of it as could be parsed.
+	if (out_byte_length != NULL) { *out_byte_length = byte_index; }
+	if (out_width != NULL)       { *out_width = width; }
+
+	return result;
+}
+
+void ucg_wrapper_init(ucg_wrapper* wrapper, ucg_int max_width) {
+	assert(wrapper != NULL);
+	assert(max_width > 0);
+
+	memset(wrapper, 0, sizeof(*wrapper));
+	wrapper->max_width = max_width;
+}
+
+ucg_int ucg_wrap_to_width(
+	ucg_wrapper* wrapper,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	ucg_int* out_offsets,
+	ucg_int capacity,
+	ucg_int* out_written
+) {
+	assert(wrapper != NULL);
+	assert(out_offsets != NULL || capacity == 0);
+	assert(capacity >= 0);
+	assert(wrapper->byte_index <= str_len);
+
+	ucg_grapheme_buffer buffer;
+	ucg_grapheme_buffer_init(&buffer, capacity);
+	buffer.wraps = out_offsets;
+	buffer.wrap_width = wrapper->max_width;
+	buffer.line_width = wrapper->line_width;
+
+	ucg_int result = _ucg_decode_grapheme_clusters_range(NULL, &buffer, &wrapper->state, str, str_len, &wrapper->byte_index);
+	wrapper->line_width = buffer.line_width;
+
+	if (out_written != NULL) { *out_written = buffer.length; }
+
+	return result;
+}
+
+// The column index walks the string with the state machine alone, whichever
+// engine was selected, since a checkpoint only has room for its state.
+
+static void ucg_column_index_add_checkpoint(ucg_column_index* index, ucg_int byte_index, ucg_int rune_index, ucg_int column, uint8_t state) {
+	assert(index->checkpoint_count < index->checkpoint_capacity);
+
+	ucg_column_checkpoint checkpoint = {(uint32_t)byte_index, (uint32_t)rune_index, (uint32_t)column, state};
+	index->checkpoints[index->checkpoint_count] = checkpoint;
+	index->checkpoint_count += 1;
+}
+
+ucg_int ucg_column_index_build(
+	ucg_allocator* allocator,
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int interval,
+
+	ucg_column_index* out_index
+) {
+	assert(allocator != NULL);
+	assert(str != NULL || str_len == 0);
+	assert((uint64_t)str_len <= UINT32_MAX);
+	assert(interval > 0);
+	assert(out_index != NULL);
+
+	ucg_column_index* index = out_index;
+	memset(index, 0, sizeof(*index));
+	index->str = str;
+	index->interval = interval;
+
+	// Every grapheme takes at least one byte, which bounds the checkpoints.
+	index->checkpoint_capacity = str_len / interval + 1;
+	index->checkpoints = (ucg_column_checkpoint*)allocator->malloc(sizeof(ucg_column_checkpoint) * index->checkpoint_capacity, allocator->ctx);
+
+	uint8_t state = UCG_GCB_DFA_START;
+	ucg_int result = 0;
+	ucg_int byte_index = 0;
+
+	while (byte_index < str_len) {
+		if (0x20 <= str[byte_index] && str[byte_index] <= 0x7E &&
+		    ucg_gcb_dfa[state][ucg_gcb_dfa_classes[UCG_GCB_OTHER]] == (UCG_GCB_DFA_BREAK | UCG_GCB_DFA_ASCII))
+		{
+			ucg_int run = ucg_printable_ascii_run(str + byte_index, str_len - byte_index);
+
+			// Each rune of the run is a grapheme of its own.
+			ucg_int i = (interval - index->grapheme_count % interval) % interval;
+			for (/**/; i < run; i += interval) {
+				ucg_column_index_add_checkpoint(index, byte_index + i, index->rune_count + i, index->width + i, i == 0 ? state : UCG_GCB_DFA_ASCII);
+			}
+
+			byte_index += run;
+			index->rune_count += run;
+			index->grapheme_count += run;
+			index->width += run;
+			state = UCG_GCB_DFA_ASCII;
+			continue;
+		}
+
+		ucg_int rune_start = byte_index;
+		ucg_rune this_rune = ucg_decode_rune(str, str_len, &byte_index);
+		if (this_rune < 0) {
+			result = this_rune;
+			byte_index = rune_start;
+			break;
+		}
+
+		ucg_properties this_properties = ucg_lookup_properties(this_rune);
+		uint8_t next = ucg_gcb_dfa[state][ucg_gcb_dfa_classes[this_properties & UCG_GCB_DFA_CLASS_MASK]];
+		if ((next & UCG_GCB_DFA_BREAK) != 0) {
+			if (index->grapheme_count % interval == 0) {
+				ucg_column_index_add_checkpoint(index, rune_start, index->rune_count, index->width, state);
+			}
+			index->grapheme_count += 1;
+			index->width += UCG_PROPERTY_WIDTH(this_properties);
+		}
+		index->rune_count += 1;
+		state = next & UCG_GCB_DFA_STATE_MASK;
+	}
+
+	index->str_len = byte_index;
+	return result;
+}
+
+void ucg_column_index_destroy(ucg_allocator* allocator, ucg_column_index* index) {
+	assert(allocator != NULL);
+	assert(index != NULL);
+
+	allocator->free(index->checkpoints, sizeof(ucg_column_checkpoint) * index->checkpoint_capacity, allocator->ctx);
+	index->checkpoints = NULL;
+	index->checkpoint_count = 0;
+	index->checkpoint_capacity = 0;
+}
+
+typedef enum {
+	UCG_COLUMN_INDEX_BY_COLUMN,
+	UCG_COLUMN_INDEX_BY_BYTE,
+	UCG_COLUMN_INDEX_BY_GRAPHEME,
+} ucg_column_index_key;
+
+static bool ucg_column_position_covers(const ucg_column_position* position, ucg_column_index_key key, ucg_int value) {
+	switch (key) {
+	case UCG_COLUMN_INDEX_BY_COLUMN:   return value < position->column + position->width;
+	case UCG_COLUMN_INDEX_BY_BYTE:     return value < position->byte_index + position->byte_length;
+	case UCG_COLUMN_INDEX_BY_GRAPHEME: return value == position->grapheme_index;
+	}
+	return false;
+}
+
+static ucg_int ucg_column_index_find(const ucg_column_index* index, ucg_column_index_key key, ucg_int value, ucg_column_position* out_position) {
+	assert(index != NULL);
+	assert(out_position != NULL);
+
+	if (value < 0 || index->checkpoint_count == 0) {
+		return UCG_EOF;
+	}
+
+	// Find the last checkpoint at or before `value`. The grapheme that
+	// covers it cannot begin any earlier.
+	ucg_int low = 0;
+	ucg_int high = index->checkpoint_count;
+	if (key == UCG_COLUMN_INDEX_BY_GRAPHEME) {
+		low = value / index->interval;
+		if (low >= high) {
+			return UCG_EOF;
+		}
+	} else {
+		while (high - low > 1) {
+			ucg_int middle = low + (high - low) / 2;
+			const ucg_column_checkpoint* checkpoint = &index->checkpoints[middle];
+			if ((key == UCG_COLUMN_INDEX_BY_COLUMN ? (ucg_int)checkpoint->column : (ucg_int)checkpoint->byte_index) <= value) {
+				low = middle;
+			} else {
+				high = middle;
+			}
+		}
+	}
+
+	const ucg_column_checkpoint* checkpoint = &index->checkpoints[low];
+	const uint8_t* str = index->str;
+	ucg_int str_len = index->str_len;
+
+	ucg_column_position position;
+	position.byte_index = checkpoint->byte_index;
+	position.rune_index = checkpoint->rune_index;
+	position.grapheme_index = low * index->interval;
+	position.column = checkpoint->column;
+	uint8_t state = checkpoint->state;
+
+	// Walk one grapheme at a time, each of them running up to the next rune
+	// that the machine breaks before. The indexed text decodes cleanly.
+	while (position.byte_index < str_len) {
+		ucg_int byte_index = position.byte_index;
+		ucg_properties this_properties = ucg_lookup_properties(ucg_decode_rune(str, str_len, &byte_index));
+		state = ucg_gcb_dfa[state][ucg_gcb_dfa_classes[this_properties & UCG_GCB_DFA_CLASS_MASK]] & UCG_GCB_DFA_STATE_MASK;
+		position.width = UCG_PROPERTY_WIDTH(this_properties);
+
+		ucg_int rune_count = 1;
+		while (byte_index < str_len) {
+			ucg_int next_byte_index = byte_index;
+			this_properties = ucg_lookup_properties(ucg_decode_rune(str, str_len, &next_byte_index));
+			uint8_t next = ucg_gcb_dfa[state][ucg_gcb_dfa_classes[this_properties & UCG_GCB_DFA_CLASS_MASK]];
+			if ((next & UCG_GCB_DFA_BREAK) != 0) {
+				break;
+			}
+			state = next & UCG_GCB_DFA_STATE_MASK;
+			byte_index = next_byte_index;
+			rune_count += 1;
+		}
+		position.byte_length = byte_index - position.byte_index;
+
+		if (ucg_column_position_covers(&position, key, value)) {
+			*out_position = position;
+			return 0;
+		}
+
+		position.byte_index = byte_index;
+		position.rune_index += rune_count;
+		position.grapheme_index += 1;
+		position.column += position.width;
+	}
+
+	return UCG_EOF;
+}
+
+ucg_int ucg_column_index_find_column(const ucg_column_index* index, ucg_int column, ucg_column_position* out_position) {
+	return ucg_column_index_find(index, UCG_COLUMN_INDEX_BY_COLUMN, column, out_position);
+}
+
+ucg_int ucg_column_index_find_byte(const ucg_column_index* index, ucg_int byte_index, ucg_column_position* out_position) {
+	return ucg_column_index_find(index, UCG_COLUMN_INDEX_BY_BYTE, byte_index, out_position);
+}
+
+ucg_int ucg_column_index_find_grapheme(const ucg_column_index* index, ucg_int grapheme_index, ucg_column_position* out_position) {
+	return ucg_column_index_find(index, UCG_COLUMN_INDEX_BY_GRAPHEME, grapheme_index, out_position);
+}
+
+// A segmentation keeps the state of the machine before each grapheme, so that
+// segmenting can be picked up again at any of them. As with the column index,
+// the machine is stepped directly, whichever engine was selected.
+//
+// The graphemes are kept in a gap buffer, with the gap wherever the last edit
+// was. Those after the gap count their byte and rune indices back from the end
+// of the string, so that an edit before them does not have to touch them.
+
+static ucg_grapheme ucg_segmentation_at(const ucg_segmentation* s, ucg_int index) {
+	if (index < s->gap_start) {
+		return s->graphemes[index];
+	}
+
+	ucg_grapheme grapheme = s->graphemes[index - s->gap_start + s->gap_end];
+	grapheme.byte_index += s->str_len;
+	grapheme.rune_index += s->rune_count;
+	return grapheme;
+}
+
+static uint8_t ucg_segmentation_state_at(const ucg_segmentation* s, ucg_int index) {
+	return s->states[index < s->gap_start ? index : index - s->gap_start + s->gap_end];
+}
+
+static void ucg_segmentation_move_gap(ucg_segmentation* s, ucg_int index) {
+	while (s->gap_start > index) {
+		s->gap_start -= 1;
+		s->gap_end -= 1;
+		s->graphemes[s->gap_end] = s->graphemes[s->gap_start];
+		s->graphemes[s->gap_end].byte_index -= s->str_len;
+		s->graphemes[s->gap_end].rune_index -= s->rune_count;
+		s->states[s->gap_end] = s->states[s->gap_start];
+	}
+	while (s->gap_start < index) {
+		s->graphemes[s->gap_start] = s->graphemes[s->gap_end];
+		s->graphemes[s->gap_start].byte_index += s->str_len;
+		s->graphemes[s->gap_start].rune_index += s->rune_count;
+		s->states[s->gap_start] = s->states[s->gap_end];
+		s->gap_start += 1;
+		s->gap_end += 1;
+	}
+}
+
+// This makes room for at least `needed` more graphemes in the gap.
+static void ucg_segmentation_grow_gap(ucg_allocator* allocator, ucg_segmentation* s, ucg_int needed) {
+	if (s->gap_end - s->gap_start >= needed) {
+		return;
+	}
+
+	ucg_int tail = s->capacity - s->gap_end;
+	ucg_int new_capacity = s->capacity < 16 ? 16 : s->capacity;
+	while (new_capacity - s->gap_start - tail < needed) {
+		new_capacity *= 2;
+	}
+
+	s->graphemes = (ucg_grapheme*)allocator->realloc(s->graphemes, sizeof(ucg_grapheme) * s->capacity, sizeof(ucg_grapheme) * new_capacity, allocator->ctx);
+	s->states = (uint8_t*)allocator->realloc(s->states, s->capacity, new_capacity, allocator->ctx);
+
+	if (tail > 0) {
+		memmove(s->graphemes + new_capacity - tail, s->graphemes + s->gap_end, sizeof(ucg_grapheme) * tail);
+		memmove(s->states + new_capacity - tail, s->states + s->gap_end, (size_t)tail);
+	}
+	s->gap_end = new_capacity - tail;
+	s->capacity = new_capacity;
+}
+
+ucg_int ucg_segmentation_build(
+	ucg_allocator* allocator,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	ucg_segmentation* out_segmentation
+) {
+	assert(out_segmentation != NULL);
+
+	memset(out_segmentation, 0, sizeof(*out_segmentation));
+	return ucg_segmentation_edit(allocator, out_segmentation, str, str_len, 0, 0, str_len);
+}
+
+ucg_int ucg_segmentation_edit(
+	ucg_allocator* allocator,
+	ucg_segmentation* segmentation,
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int edit_start,
+	ucg_int removed_len,
+	ucg_int inserted_len
+) {
+	assert(allocator != NULL);
+	assert(segmentation != NULL);
+	assert(str != NULL || str_len == 0);
+	assert(0 <= edit_start && 0 <= removed_len && 0 <= inserted_len);
+	assert(edit_start + removed_len <= segmentation->str_len);
+	assert(str_len == segmentation->str_len - removed_len + inserted_len);
+	// The edit is found from where it starts and what it inserts, so the
+	// length removed only serves to check the lengths above.
+	(void)removed_len;
+
+	ucg_segmentation* s = segmentation;
+	ucg_int edit_end = edit_start + inserted_len;
+
+	// Restart with the last grapheme that begins before the edit, as the edit
+	// may join on to it. Which one that is can be found by a binary search.
+	ucg_int first = 0;
+	{
+		ucg_int high = s->grapheme_count;
+		while (high - first > 1) {
+			ucg_int middle = first + (high - first) / 2;
+			if (ucg_segmentation_at(s, middle).byte_index < edit_start) {
+				first = middle;
+			} else {
+				high = middle;
+			}
+		}
+	}
+
+	uint8_t state = UCG_GCB_DFA_START;
+	ucg_int byte_index = 0;
+	ucg_int rune_index = 0;
+	if (first < s->grapheme_count && ucg_segmentation_at(s, first).byte_index < edit_start) {
+		ucg_grapheme restart = ucg_segmentation_at(s, first);
+		state = ucg_segmentation_state_at(s, first);
+		byte_index = restart.byte_index;
+		rune_index = restart.rune_index;
+	}
+
+	// The old graphemes from `first` on are all after the gap, and count back
+	// from the end of the string, which is the same before and after the edit.
+	// New graphemes are written into the gap, and old ones are dropped from
+	// its end as they are passed, until a grapheme begins where an old one
+	// did, past the edit, with the machine in the same state. From there on,
+	// nothing can differ from before.
+	ucg_segmentation_move_gap(s, first);
+	s->grapheme_count = first;
+
+	ucg_int result = 0;
+	bool converged = false;
+
+	while (byte_index < str_len) {
+		if (0x20 <= str[byte_index] && str[byte_index] <= 0x7E &&
+		    ucg_gcb_dfa[state][ucg_gcb_dfa_classes[UCG_GCB_OTHER]] == (UCG_GCB_DFA_BREAK | UCG_GCB_DFA_ASCII) &&
+		    (byte_index < edit_end || s->gap_end == s->capacity))
+		{
+			// Runs of printable ASCII are only taken in bulk up to the end
+			// of the edit, past which every grapheme is checked against the
+			// old ones, unless there are none left to check against.
+			ucg_int run = ucg_printable_ascii_run(str + byte_index, str_len - byte_index);
+			if (byte_index < edit_end && run > edit_end - byte_index) {
+				run = edit_end - byte_index;
+			}
+
+			ucg_segmentation_grow_gap(allocator, s, run);
+			for (ucg_int i = 0; i < run; i += 1) {
+				ucg_grapheme append = {byte_index + i, rune_index + i, 1};
+				s->graphemes[s->gap_start + i] = append;
+				s->states[s->gap_start + i] = i == 0 ? state : UCG_GCB_DFA_ASCII;
+			}
+
+			s->gap_start += run;
+			s->width += run;
+			byte_index += run;
+			rune_index += run;
+			state = UCG_GCB_DFA_ASCII;
+			continue;
+		}
+
+		ucg_int rune_start = byte_index;
+		ucg_rune this_rune = ucg_decode_rune(str, str_len, &byte_index);
+		if (this_rune < 0) {
+			result = this_rune;
+			break;
+		}
+
+		ucg_properties this_properties = ucg_lookup_properties(this_rune);
+		uint8_t next = ucg_gcb_dfa[state][ucg_gcb_dfa_classes[this_properties & UCG_GCB_DFA_CLASS_MASK]];
+		if ((next & UCG_GCB_DFA_BREAK) != 0) {
+			if (rune_start >= edit_end) {
+				while (s->gap_end < s->capacity && s->graphemes[s->gap_end].byte_index + str_len < rune_start) {
+					s->width -= s->graphemes[s->gap_end].width;
+					s->gap_end += 1;
+				}
+				if (s->gap_end < s->capacity &&
+				    s->graphemes[s->gap_end].byte_index + str_len == rune_start &&
+				    s->states[s->gap_end] == state)
+				{
+					converged = true;
+					break;
+				}
+			}
+
+			ucg_segmentation_grow_gap(allocator, s, 1);
+			ucg_grapheme append = {rune_start, rune_index, UCG_PROPERTY_WIDTH(this_properties)};
+			s->graphemes[s->gap_start] = append;
+			s->states[s->gap_start] = state;
+			s->gap_start += 1;
+			s->width += append.width;
+		}
+		rune_index += 1;
+		state = next & UCG_GCB_DFA_STATE_MASK;
+	}
+
+	if (converged) {
+		// The old graphemes after the gap have the same rune index as the one
+		// where it converged, counted back from the end.
+		s->rune_count = rune_index - s->graphemes[s->gap_end].rune_index;
+	} else {
+		for (/**/; s->gap_end < s->capacity; s->gap_end += 1) {
+			s->width -= s->graphemes[s->gap_end].width;
+		}
+		s->rune_count = rune_index;
+		s->result = result;
+	}
+
+	s->str_len = str_len;
+	s->grapheme_count = s->gap_start + s->capacity - s->gap_end;
+
+	return s->result;
+}
+
+ucg_int ucg_segmentation_grapheme(const ucg_segmentation* segmentation, ucg_int index, ucg_grapheme* out_grapheme) {
+	assert(segmentation != NULL);
+	assert(out_grapheme != NULL);
+
+	if (index < 0 || index >= segmentation->grapheme_count) {
+		return UCG_EOF;
+	}
+	*out_grapheme = ucg_segmentation_at(segmentation, index);
+	return 0;
+}
+
+ucg_int ucg_segmentation_totals(
+	const ucg_segmentation* segmentation,
+
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width
+) {
+	assert(segmentation != NULL);
+
+	if (out_rune_count != NULL)     { *out_rune_count = segmentation->rune_count; }
+	if (out_grapheme_count != NULL) { *out_grapheme_count = segmentation->grapheme_count; }
+	if (out_width != NULL)          { *out_width = segmentation->width; }
+
+	return segmentation->result;
+}
+
+void ucg_segmentation_destroy(ucg_allocator* allocator, ucg_segmentation* segmentation) {
+	assert(allocator != NULL);
+	assert(segmentation != NULL);
+
+	allocator->free(segmentation->graphemes, sizeof(ucg_grapheme) * segmentation->capacity, allocator->ctx);
+	allocator->free(segmentation->states, segmentation->capacity, allocator->ctx);
+	memset(segmentation, 0, sizeof(*segmentation));
+}
+
+ucg_int ucg_grapheme_count_limited(
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int max_graphemes,
+	ucg_int max_width,
+
+	ucg_int* out_byte_index,
+	ucg_int* out_runes,
+	ucg_int* out_graphemes,
+	ucg_int* out_width
+) {
+	assert(str != NULL || str_len == 0);
+
+	// Nothing is written to the buffer; it only runs out of room.
+	ucg_grapheme_buffer buffer;
+	ucg_grapheme_buffer_init(&buffer, max_graphemes < 0 ? INT_FAST32_MAX : max_graphemes);
+	if (max_width >= 0) {
+		buffer.width_left = max_width;
+	}
+
+	ucg_decoder_state state = {0};
+
+	ucg_int byte_index = 0;
+	ucg_int result = _ucg_decode_grapheme_clusters_range(NULL, &buffer, &state, str, str_len, &byte_index);
+	if (result == UCG_BUFFER_FULL) {
+		result = UCG_LIMIT_REACHED;
+	}
+
+	if (out_byte_index != NULL) { *out_byte_index = byte_index; }
+	if (out_runes != NULL)      { *out_runes = state.rune_count; }
+	if (out_graphemes != NULL)  { *out_graphemes = state.grapheme_count; }
+	if (out_width != NULL)      { *out_width = state.width; }
+
+	return result;
 }
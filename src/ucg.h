@@ -46,7 +46,11 @@ typedef struct {
 
 /* This procedure merely counts the runes, graphemes, and width without
  * incurring any allocations. It is a thin wrapper over
- * ucg_decode_grapheme_clusters that passes NULL for an allocator. */
+ * ucg_decode_grapheme_clusters that passes NULL for an allocator.
+ *
+ * Only what is asked for is computed. If `out_graphemes` and `out_width` are
+ * both NULL, the string is only checked and counted as UTF-8, which is many
+ * times faster than segmenting it. */
 ucg_int ucg_grapheme_count(
 	const uint8_t* str,
 	ucg_int str_len,
@@ -79,6 +83,33 @@ ucg_int ucg_decode_grapheme_clusters(
 	ucg_int* out_grapheme_count,
 	ucg_int* out_width);
 
+/* These procedures are the same as `ucg_decode_grapheme_clusters`, except
+ * that the string is UTF-16 or UTF-32 in native byte order, and `str_len` and
+ * every `byte_index` count 16-bit or 32-bit code units instead of bytes.
+ *
+ * A surrogate that is not part of a pair, or a UTF-32 code unit that is not a
+ * Unicode scalar value, is UCG_INVALID_RUNE. A high surrogate at the end of the
+ * string is UCG_EXPECTED_MORE_BYTES. */
+ucg_int ucg_decode_grapheme_clusters_utf16(
+	ucg_allocator* allocator,
+	const uint16_t* str,
+	ucg_int str_len,
+
+	ucg_grapheme** out_graphemes,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width);
+
+ucg_int ucg_decode_grapheme_clusters_utf32(
+	ucg_allocator* allocator,
+	const uint32_t* str,
+	ucg_int str_len,
+
+	ucg_grapheme** out_graphemes,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width);
+
 
 /* These procedures are part of how UCG decodes graphemes, and as such, they are
  * made public here in the event that they are useful. */
@@ -88,12 +119,40 @@ typedef ucg_int ucg_rune;
 #define UCG_EOF                 (-1)
 #define UCG_EXPECTED_MORE_BYTES (-2)
 #define UCG_INVALID_RUNE        (-3)
+#define UCG_BUFFER_FULL         (-4)
+#define UCG_LIMIT_REACHED       (-5)
 
 /* This procedure decodes a byte string and returns a valid Unicode codepoint or
  * one of the errors above. The byte iterator is increased as needed while
- * reading the string. */
+ * reading the string.
+ *
+ * A sequence that is cut short by a byte other than a continuation byte gives
+ * UCG_INVALID_RUNE, as does a continuation byte with no lead byte before it or
+ * a sequence that would be a surrogate or lie past U+10FFFF. So the runes
+ * decoded from a piece of text never depend on what comes before it, and every
+ * rune returned can be looked up. A sequence cut short by the end of the string
+ * gives UCG_EXPECTED_MORE_BYTES instead. */
 ucg_rune ucg_decode_rune(const uint8_t* str, ucg_int str_len, ucg_int* byte_iterator);
 
+/* This procedure decodes runes in bulk into `out_runes`, which has room for
+ * `capacity` of them. The number written is stored in `out_written`, and the
+ * number of bytes they took up in `out_consumed`.
+ *
+ * It accepts exactly what `ucg_decode_rune` accepts. If a rune cannot be
+ * decoded, the runes before it are written, `out_consumed` is left at the
+ * offset where it begins, and the error is returned. If the buffer fills up
+ * before the end of the string, UCG_BUFFER_FULL is returned, and decoding may
+ * be continued from `str + *out_consumed`. */
+ucg_int ucg_decode_runes(
+	const uint8_t* str,
+	ucg_int str_len,
+
+	uint32_t* out_runes,
+	ucg_int capacity,
+
+	ucg_int* out_consumed,
+	ucg_int* out_written);
+
 /* The following procedures all return true or false based on whether a Unicode
  * codepoint fits into a certain class. */
 
@@ -119,6 +178,555 @@ bool ucg_is_indic_conjunct_break_extend     (ucg_rune r);
 bool ucg_is_gcb_prepend_class               (ucg_rune r);
 bool ucg_is_gcb_extend_class                (ucg_rune r);
 
+/* This procedure estimates how many monospace cells wide a rune is, based on
+ * Standard Annex #11. It returns 2 for East_Asian_Width=F or W, 0 for controls
+ * and zero-width runes, and 1 in all other cases. */
+ucg_int ucg_normalized_east_asian_width(ucg_rune r);
+
+
+/* This is the state that UCG carries from one rune to the next while it decodes
+ * graphemes. It is made public so that it can live on the stack inside of the
+ * structures below, but its fields are internal and should not be relied upon.
+ *
+ * A zeroed state is the state at the start of text. */
+typedef enum {
+	UCG_SEQUENCE_NONE,
+	UCG_SEQUENCE_INDIC,
+	UCG_SEQUENCE_EMOJI,
+	UCG_SEQUENCE_REGIONAL,
+} ucg_grapheme_cluster_sequence;
+
+typedef struct {
+	ucg_grapheme* graphemes;
+	ucg_int rune_count;
+	ucg_int grapheme_count;
+	ucg_int width;
+
+	ucg_rune last_rune;
+	uint16_t last_properties;
+	bool last_rune_breaks_forward;
+
+	ucg_int last_width;
+	ucg_int last_grapheme_count;
+
+	bool bypass_next_rune;
+
+	ucg_int regional_indicator_counter;
+
+	ucg_int supplementary_rune_count;
+
+	ucg_grapheme_cluster_sequence current_sequence;
+	bool continue_sequence;
+
+	uint8_t dfa_state;
+} ucg_decoder_state;
+
+/* This is the data that is yielded by the iterator for each grapheme. */
+typedef struct {
+	ucg_int byte_index;
+	ucg_int byte_length;
+	ucg_int rune_count;
+	ucg_int width;
+} ucg_grapheme_span;
+
+/* The iterator walks a string one grapheme at a time without allocating. It
+ * may be placed on the stack and abandoned at any point. */
+typedef struct {
+	const uint8_t* str;
+	ucg_int str_len;
+	ucg_int byte_index;
+	ucg_int error;
+
+	ucg_grapheme_span pending;
+	ucg_decoder_state state;
+} ucg_iterator;
+
+void ucg_iterator_init(ucg_iterator* it, const uint8_t* str, ucg_int str_len);
+
+/* This procedure writes the next grapheme to `out_grapheme` and returns 0.
+ *
+ * Once the string is exhausted, it returns UCG_EOF. If the string could not be
+ * parsed as UTF-8, the graphemes before the error are yielded first, after
+ * which the error is returned instead. */
+ucg_int ucg_iterator_next(ucg_iterator* it, ucg_grapheme_span* out_grapheme);
+
+/* This procedure returns the byte offset where the last grapheme that begins
+ * before `offset` begins, or UCG_EOF if `offset` is 0.
+ *
+ * Only the text just before `offset` is read, which is a few runes as a rule.
+ * Long graphemes and long runs of regional indicators make it read further back
+ * in proportion to their length, but the cost never depends on how far into the
+ * string `offset` is.
+ *
+ * The text that is read must be valid UTF-8, otherwise one of the error values
+ * above is returned. */
+ucg_int ucg_prev_grapheme_boundary(const uint8_t* str, ucg_int str_len, ucg_int offset);
+
+/* This procedure returns the byte offset where the grapheme that contains the
+ * byte at `offset` begins, or UCG_EOF if `offset` is the length of the string.
+ * It reads only the rune at `offset` and the text just before it, as much as
+ * `ucg_prev_grapheme_boundary` would, so the cost does not depend on how far
+ * into the string `offset` is. It agrees with a full pass of
+ * `ucg_decode_grapheme_clusters`. */
+ucg_int ucg_find_boundary_at(const uint8_t* str, ucg_int str_len, ucg_int offset);
+
+/* The reverse iterator walks a string one grapheme at a time from the end to
+ * the start, yielding the same graphemes as `ucg_iterator` in reverse. */
+typedef struct {
+	const uint8_t* str;
+	ucg_int str_len;
+	ucg_int byte_index;
+} ucg_reverse_iterator;
+
+void ucg_reverse_iterator_init(ucg_reverse_iterator* it, const uint8_t* str, ucg_int str_len);
+
+/* This procedure writes the previous grapheme to `out_grapheme` and returns 0,
+ * or UCG_EOF once the start of the string has been reached. */
+ucg_int ucg_reverse_iterator_prev(ucg_reverse_iterator* it, ucg_grapheme_span* out_grapheme);
+
+/* The stream counts the runes, graphemes, and width of text that arrives in
+ * pieces, such as from a socket or a pipe. A chunk may end anywhere, even in
+ * the middle of a rune or a grapheme, and the totals will be the same as if
+ * the whole text had been passed to `ucg_grapheme_count` at once.
+ *
+ * The stream does not allocate and does not hold on to any chunk. */
+typedef struct {
+	ucg_decoder_state state;
+	uint8_t partial[4];
+	ucg_int partial_len;
+	ucg_int error;
+} ucg_stream;
+
+void ucg_stream_init(ucg_stream* stream);
+
+/* This procedure returns 0 on success or negative if the text could not be
+ * parsed as UTF-8, after which all further input is ignored. */
+ucg_int ucg_stream_feed(ucg_stream* stream, const uint8_t* chunk, ucg_int chunk_len);
+
+/* This procedure ends the text and writes out the totals. The return value is
+ * the same as what `ucg_grapheme_count` would have returned for the whole text,
+ * including UCG_EXPECTED_MORE_BYTES if it ended in the middle of a rune. */
+ucg_int ucg_stream_finish(
+	ucg_stream* stream,
+
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width);
+
+/* The cursor records how far `ucg_decode_grapheme_clusters_into` got through a
+ * string, so that it may be called again to carry on where it stopped. */
+typedef struct {
+	ucg_decoder_state state;
+	ucg_int byte_index;
+} ucg_cursor;
+
+void ucg_cursor_init(ucg_cursor* cursor);
+
+/* This procedure is like `ucg_decode_grapheme_clusters`, except that graphemes
+ * are written to `out_graphemes`, which has room for `capacity` of them, and
+ * no allocation ever takes place. The number written is stored in
+ * `out_written`.
+ *
+ * If the buffer fills up before the end of the string, UCG_BUFFER_FULL is
+ * returned. Once the buffer has been drained, call this again with the same
+ * cursor and string to continue. The indices in each grapheme are relative to
+ * the whole string, and the totals count everything decoded so far.
+ *
+ * The return value is otherwise 0 at the end of the string, or negative (one of
+ * the error values above) if there was a trouble with parsing it as UTF-8. */
+ucg_int ucg_decode_grapheme_clusters_into(
+	ucg_cursor* cursor,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	ucg_grapheme* out_graphemes,
+	ucg_int capacity,
+	ucg_int* out_written,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width);
+
+/* These select which fields of each grapheme are written as columns. */
+#define UCG_FIELD_BYTE_INDEX  (1 << 0)
+#define UCG_FIELD_RUNE_INDEX  (1 << 1)
+#define UCG_FIELD_WIDTH       (1 << 2)
+#define UCG_FIELD_UTF16_INDEX (1 << 3)
+
+/* This describes a set of caller-owned arrays, one per field, that each have
+ * room for the same number of graphemes. Only the arrays named in `fields` are
+ * written; the others may be NULL.
+ *
+ * With UCG_FIELD_UTF16_INDEX, each grapheme is marked with the number of UTF-16
+ * code units that come before it, which is its rune index plus one for every
+ * rune before it outside of the Basic Multilingual Plane. This is the offset
+ * that protocols such as LSP count characters in.
+ *
+ * The indices are stored as 32-bit integers, so the string must be no longer
+ * than UINT32_MAX bytes. */
+typedef struct {
+	ucg_int fields;
+
+	uint32_t* byte_indices;
+	uint32_t* rune_indices;
+	uint8_t*  widths;
+	uint32_t* utf16_indices;
+} ucg_grapheme_columns;
+
+/* This procedure is the same as `ucg_decode_grapheme_clusters_into`, except
+ * that the requested fields of each grapheme are written to separate arrays. */
+ucg_int ucg_decode_grapheme_columns(
+	ucg_cursor* cursor,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	const ucg_grapheme_columns* columns,
+	ucg_int capacity,
+	ucg_int* out_written,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width);
+
+/* This procedure is the same as `ucg_decode_grapheme_columns`, except that the
+ * runes are also written to `out_runes`, which has room for `rune_capacity` of
+ * them, in the same pass over the string. The number written is stored in
+ * `out_runes_written`.
+ *
+ * With UCG_FIELD_RUNE_INDEX, each grapheme is marked with the index of the rune
+ * it begins with. Like the totals, these count from the start of the string, so
+ * the first rune written by each call has the index that `out_rune_count` held
+ * after the call before it.
+ *
+ * UCG_BUFFER_FULL is returned once either buffer fills up. */
+ucg_int ucg_decode_runes_and_graphemes(
+	ucg_cursor* cursor,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	uint32_t* out_runes,
+	ucg_int rune_capacity,
+	ucg_int* out_runes_written,
+
+	const ucg_grapheme_columns* columns,
+	ucg_int capacity,
+	ucg_int* out_written,
+
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width);
+
+/* This procedure marks the first byte of every grapheme in `out_boundaries`, a
+ * bitmap of `(str_len + 7) / 8` bytes with one bit for each byte of the string.
+ * Byte `i` of the string is bit `i % 8` of byte `i / 8`. The bitmap is cleared
+ * before it is written.
+ *
+ * The return value and the totals are the same as for `ucg_grapheme_count`. */
+ucg_int ucg_decode_grapheme_boundaries(
+	const uint8_t* str,
+	ucg_int str_len,
+
+	uint8_t* out_boundaries,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width);
+
+/* This procedure is the same as `ucg_decode_grapheme_clusters`, except that the
+ * string is split into up to `thread_count` pieces which are segmented at the
+ * same time on separate threads. The result is exactly what one call to
+ * `ucg_decode_grapheme_clusters` would give.
+ *
+ * The pieces are split just after runes that no grapheme rule can look past,
+ * so that each thread knows the state to start in. Strings too short to be
+ * worth splitting are segmented on the calling thread, as is everything if the
+ * library was built with UCG_NO_THREADS.
+ *
+ * If graphemes are wanted, the string is read twice: once to count them, so
+ * that one array can be allocated, and once more to fill it in. The allocator
+ * is only ever called from the calling thread. */
+ucg_int ucg_decode_grapheme_clusters_parallel(
+	ucg_allocator* allocator,
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int thread_count,
+
+	ucg_grapheme** out_graphemes,
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width);
+
+/* A summary describes how a piece of text segments without knowing what comes
+ * before or after it, so that a long text may be cut into pieces, summarized
+ * in any order or on any number of machines, and put back together.
+ *
+ * Merging the summaries of two neighbouring pieces gives exactly the summary
+ * of the two pieces as one, whether the cut fell in the middle of a rune, a
+ * grapheme, an emoji sequence, or a run of regional indicators. Merging is
+ * associative, and summarizing an empty string gives the summary that changes
+ * nothing when merged.
+ *
+ * The fields are private. A summary holds no pointers, so it may be copied or
+ * sent elsewhere as it is. */
+#define UCG_SUMMARY_STATES 32
+
+typedef struct {
+	ucg_int byte_count;
+	ucg_int rune_count;
+	ucg_int error;
+
+	uint8_t head[4];
+	ucg_int head_length;
+	uint8_t tail[4];
+	ucg_int tail_length;
+
+	uint8_t exit_state[UCG_SUMMARY_STATES];
+	ucg_int grapheme_count[UCG_SUMMARY_STATES];
+	ucg_int width[UCG_SUMMARY_STATES];
+} ucg_summary;
+
+void ucg_summarize(const uint8_t* str, ucg_int str_len, ucg_summary* out_summary);
+
+/* This procedure writes the summary of the text of `a` followed by the text of
+ * `b` to `out_summary`, which may be either of them. */
+void ucg_summary_merge(const ucg_summary* a, const ucg_summary* b, ucg_summary* out_summary);
+
+/* This procedure writes out the totals of the summarized text, taken as a whole
+ * string. The return value is the same as what `ucg_grapheme_count` would have
+ * returned for that string. */
+ucg_int ucg_summary_totals(
+	const ucg_summary* summary,
+
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width);
+
+/* This procedure counts the runes, graphemes, and width of every string in an
+ * array laid out as Apache Arrow lays out its UTF-8 columns: the strings sit
+ * back to back in `data`, and string `i` is the bytes from `offsets[i]` up to
+ * `offsets[i + 1]`, so there are `string_count + 1` offsets.
+ *
+ * Each output array has room for `string_count` values and may be NULL if it
+ * is not wanted. Every string gets the same result and totals as a call to
+ * `ucg_grapheme_count` would give it, so one string that cannot be parsed as
+ * UTF-8 does not keep the others from being counted.
+ *
+ * The return value is the number of strings that could not be parsed. */
+ucg_int ucg_grapheme_count_batch(
+	const uint8_t* data,
+	const int32_t* offsets,
+	ucg_int string_count,
+
+	ucg_int* out_results,
+	ucg_int* out_rune_counts,
+	ucg_int* out_grapheme_counts,
+	ucg_int* out_widths);
+
+/* This procedure finds how much of a string fits into `max_width` columns
+ * without cutting a grapheme in two. The number of bytes that fit is stored in
+ * `out_byte_length`, and the width of those bytes in `out_width`.
+ *
+ * If the whole string does not fit, room is left for `ellipsis_width` more
+ * columns, so that an ellipsis may be put after the bytes that fit. Whether the
+ * string was cut short can be told by comparing `out_byte_length` to
+ * `str_len`.
+ *
+ * Only as much of the string is read as is needed to decide, so the time taken
+ * depends on `max_width` rather than on the length of the string.
+ *
+ * The return value is 0, or negative (one of the error values above) if the
+ * string could not be parsed as UTF-8 before the point where it was cut, in
+ * which case the outputs describe the text before the error. */
+ucg_int ucg_truncate_to_width(
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int max_width,
+	ucg_int ellipsis_width,
+
+	ucg_int* out_byte_length,
+	ucg_int* out_width);
+
+/* The wrapper lays a string out on lines of at most `max_width` columns,
+ * breaking lines only between graphemes. A grapheme that is wider than the
+ * whole line, such as a wide character on a line of one column, is given a
+ * line of its own. */
+typedef struct {
+	ucg_decoder_state state;
+	ucg_int byte_index;
+	ucg_int max_width;
+	ucg_int line_width;
+} ucg_wrapper;
+
+void ucg_wrapper_init(ucg_wrapper* wrapper, ucg_int max_width);
+
+/* This procedure writes the byte offsets where each new line begins to
+ * `out_offsets`, which has room for `capacity` of them, while the string is
+ * being segmented. The number written is stored in `out_written`. The string
+ * is taken as a single line; any line breaks in it are left to the caller.
+ *
+ * If the buffer fills up before the end of the string, UCG_BUFFER_FULL is
+ * returned. Once the buffer has been drained, call this again with the same
+ * wrapper and string to continue.
+ *
+ * The return value is otherwise 0 at the end of the string, or negative (one of
+ * the error values above) if there was a trouble with parsing it as UTF-8. */
+ucg_int ucg_wrap_to_width(
+	ucg_wrapper* wrapper,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	ucg_int* out_offsets,
+	ucg_int capacity,
+	ucg_int* out_written);
+
+/* The column index answers questions about where the graphemes of a long
+ * string begin, by display column, by byte offset or by grapheme number,
+ * without segmenting the whole string again for each one.
+ *
+ * It remembers where every `interval`th grapheme begins, along with what the
+ * segmenter needs to carry on from there, in 16 bytes. A lookup finds the
+ * nearest such checkpoint and segments at most `interval` graphemes from it.
+ * An interval of 256 keeps the index to 1/16th of the string or less, and to
+ * much less for text that is not plain ASCII.
+ *
+ * The string is not copied, and must outlive the index. The indices are
+ * stored as 32-bit integers, so the string must be no longer than UINT32_MAX
+ * bytes. */
+typedef struct {
+	uint32_t byte_index;
+	uint32_t rune_index;
+	uint32_t column;
+	uint8_t state;
+} ucg_column_checkpoint;
+
+typedef struct {
+	const uint8_t* str;
+	ucg_int str_len;
+	ucg_int interval;
+
+	ucg_column_checkpoint* checkpoints;
+	ucg_int checkpoint_count;
+	ucg_int checkpoint_capacity;
+
+	ucg_int rune_count;
+	ucg_int grapheme_count;
+	ucg_int width;
+} ucg_column_index;
+
+/* This is what a lookup finds out about a grapheme. */
+typedef struct {
+	ucg_int byte_index;
+	ucg_int byte_length;
+	ucg_int rune_index;
+	ucg_int grapheme_index;
+	ucg_int column;
+	ucg_int width;
+} ucg_column_position;
+
+/* This procedure indexes `str` in one pass, allocating the checkpoints with
+ * `allocator`. The totals of the string are left in the index.
+ *
+ * The return value is 0, or negative (one of the error values above) if the
+ * string could not be parsed as UTF-8, in which case only the text before the
+ * error is indexed. Either way, the index must be destroyed. */
+ucg_int ucg_column_index_build(
+	ucg_allocator* allocator,
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int interval,
+
+	ucg_column_index* out_index);
+
+void ucg_column_index_destroy(ucg_allocator* allocator, ucg_column_index* index);
+
+/* These procedures find the grapheme that covers a display column, the one
+ * that contains a byte offset, or the one with a given number, and write it to
+ * `out_position`. A grapheme of zero width covers no column.
+ *
+ * The return value is 0, or UCG_EOF if there is no such grapheme. */
+ucg_int ucg_column_index_find_column(const ucg_column_index* index, ucg_int column, ucg_column_position* out_position);
+ucg_int ucg_column_index_find_byte(const ucg_column_index* index, ucg_int byte_index, ucg_column_position* out_position);
+ucg_int ucg_column_index_find_grapheme(const ucg_column_index* index, ucg_int grapheme_index, ucg_column_position* out_position);
+
+/* A segmentation holds the graphemes of a string that is being edited, along
+ * with the state of the segmenter before each of them, so that it can be kept
+ * up to date as the string changes without segmenting all of it again.
+ *
+ * The graphemes are kept around the last edit in such a way that one more edit
+ * nearby costs about as much as the text it touches, however long the string.
+ * The fields are private. */
+typedef struct {
+	ucg_grapheme* graphemes;
+	uint8_t* states;
+	ucg_int capacity;
+	ucg_int gap_start;
+	ucg_int gap_end;
+
+	ucg_int str_len;
+	ucg_int rune_count;
+	ucg_int grapheme_count;
+	ucg_int width;
+	ucg_int result;
+} ucg_segmentation;
+
+/* This procedure segments `str` into a new segmentation, allocating it with
+ * `allocator`. The return value is the same as `ucg_grapheme_count` would give,
+ * and either way the segmentation must be destroyed. */
+ucg_int ucg_segmentation_build(
+	ucg_allocator* allocator,
+	const uint8_t* str,
+	ucg_int str_len,
+
+	ucg_segmentation* out_segmentation);
+
+/* This procedure brings a segmentation up to date after `removed_len` bytes at
+ * `edit_start` were replaced with `inserted_len` new ones. `str` is the whole
+ * string after the edit.
+ *
+ * Segmenting restarts at the last grapheme that begins before the edit, and
+ * stops as soon as it is back in step with the old graphemes after the edit,
+ * which is usually at the first grapheme after it.
+ *
+ * The return value is the same as `ucg_grapheme_count` would give for `str`. */
+ucg_int ucg_segmentation_edit(
+	ucg_allocator* allocator,
+	ucg_segmentation* segmentation,
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int edit_start,
+	ucg_int removed_len,
+	ucg_int inserted_len);
+
+/* This procedure writes the grapheme with the given number to `out_grapheme`
+ * and returns 0, or UCG_EOF if there is no such grapheme. */
+ucg_int ucg_segmentation_grapheme(const ucg_segmentation* segmentation, ucg_int index, ucg_grapheme* out_grapheme);
+
+/* This procedure writes out the totals of the string as it was last edited. */
+ucg_int ucg_segmentation_totals(
+	const ucg_segmentation* segmentation,
+
+	ucg_int* out_rune_count,
+	ucg_int* out_grapheme_count,
+	ucg_int* out_width);
+
+void ucg_segmentation_destroy(ucg_allocator* allocator, ucg_segmentation* segmentation);
+
+/* This procedure is like `ucg_grapheme_count`, except that it stops at the
+ * first grapheme that would take the count past `max_graphemes` or the width
+ * past `max_width`, and returns UCG_LIMIT_REACHED. A negative limit is no limit.
+ *
+ * The totals are those of the text before where it stopped, and the offset of
+ * that point is stored in `out_byte_index`. Only as much of the string is read
+ * as is needed to decide, so asking whether a string is a single grapheme costs
+ * the same however long it is. */
+ucg_int ucg_grapheme_count_limited(
+	const uint8_t* str,
+	ucg_int str_len,
+	ucg_int max_graphemes,
+	ucg_int max_width,
+
+	ucg_int* out_byte_index,
+	ucg_int* out_runes,
+	ucg_int* out_graphemes,
+	ucg_int* out_width);
+
 #ifdef __cplusplus
 }
 #endif
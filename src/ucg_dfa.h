@@ -0,0 +1,81 @@
+/*
+ * SPDX-FileCopyrightText: (c) 2024 Feoramund
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#ifndef _UCG_DFA_INCLUDED
+#define _UCG_DFA_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+//
+// This file is generated by `tools/gen_dfa.c` from the rules in `ucg.c`.
+// Do not edit it by hand.
+//
+// The low 7 bits of a rune's record select its class through
+// `ucg_gcb_dfa_classes`. Each entry of `ucg_gcb_dfa` is the next state,
+// with `UCG_GCB_DFA_BREAK` set if a grapheme begins with the rune.
+//
+
+#define UCG_GCB_DFA_CLASS_COUNT 18
+#define UCG_GCB_DFA_STATE_COUNT 21
+
+#define UCG_GCB_DFA_CLASS_MASK  0x7F
+#define UCG_GCB_DFA_STATE_MASK  0x7F
+#define UCG_GCB_DFA_BREAK       0x80
+
+// The state at the start of text.
+#define UCG_GCB_DFA_START       0
+// The state after any rune of printable 7-bit ASCII.
+#define UCG_GCB_DFA_ASCII       3
+
+// The classes after which the state no longer depends on any earlier rune,
+// one bit per class.
+#define UCG_GCB_DFA_SYNC_CLASSES 0x1B90D
+
+// The states that the machine can be in after any rune, one bit per state.
+#define UCG_GCB_DFA_RESUME_STATES 0x1FFFFE
+
+static const uint8_t ucg_gcb_dfa_classes[128] = {
+	 3,  2,  1,  0,  6,  0, 17,  7,  8, 11, 12, 13, 15, 16,  0,  0,
+	 0,  0,  0,  0, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 9,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  5, 14,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 4,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+static const uint8_t ucg_gcb_dfa[21][18] = {
+	{0x81, 0x81, 0x82, 0x83, 0x84, 0x83, 0x83, 0x85, 0x83, 0x86, 0x83, 0x87, 0x88, 0x89, 0x83, 0x88, 0x89, 0x8A},
+	{0x81, 0x81, 0x82, 0x83, 0x83, 0x83, 0x83, 0x83, 0x83, 0x83, 0x83, 0x87, 0x88, 0x89, 0x83, 0x88, 0x89, 0x83},
+	{0x81, 0x03, 0x82, 0x83, 0x83, 0x83, 0x83, 0x83, 0x83, 0x83, 0x83, 0x87, 0x88, 0x89, 0x83, 0x88, 0x89, 0x83},
+	{0x81, 0x81, 0x82, 0x83, 0x84, 0x03, 0x03, 0x85, 0x03, 0x86, 0x03, 0x87, 0x88, 0x89, 0x03, 0x88, 0x89, 0x8A},
+	{0x81, 0x81, 0x82, 0x83, 0x84, 0x04, 0x04, 0x85, 0x03, 0x86, 0x04, 0x87, 0x88, 0x89, 0x0B, 0x88, 0x89, 0x8A},
+	{0x81, 0x81, 0x82, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x07, 0x08, 0x09, 0x03, 0x08, 0x09, 0x03},
+	{0x81, 0x81, 0x82, 0x83, 0x84, 0x0C, 0x03, 0x85, 0x03, 0x83, 0x0D, 0x87, 0x88, 0x89, 0x0E, 0x88, 0x89, 0x8A},
+	{0x81, 0x81, 0x82, 0x83, 0x84, 0x03, 0x03, 0x85, 0x03, 0x86, 0x03, 0x07, 0x08, 0x89, 0x03, 0x08, 0x09, 0x8A},
+	{0x81, 0x81, 0x82, 0x83, 0x84, 0x03, 0x03, 0x85, 0x03, 0x86, 0x03, 0x87, 0x08, 0x09, 0x03, 0x88, 0x89, 0x8A},
+	{0x81, 0x81, 0x82, 0x83, 0x84, 0x03, 0x03, 0x85, 0x03, 0x86, 0x03, 0x87, 0x88, 0x09, 0x03, 0x88, 0x89, 0x8A},
+	{0x81, 0x81, 0x82, 0x83, 0x8F, 0x03, 0x03, 0x85, 0x03, 0x90, 0x03, 0x87, 0x88, 0x89, 0x0A, 0x88, 0x89, 0x03},
+	{0x81, 0x81, 0x82, 0x83, 0x04, 0x03, 0x03, 0x85, 0x03, 0x86, 0x03, 0x87, 0x88, 0x89, 0x0B, 0x88, 0x89, 0x8A},
+	{0x81, 0x81, 0x82, 0x83, 0x84, 0x03, 0x03, 0x85, 0x03, 0x83, 0x0D, 0x87, 0x88, 0x89, 0x0E, 0x88, 0x89, 0x8A},
+	{0x81, 0x81, 0x82, 0x83, 0x84, 0x0C, 0x03, 0x85, 0x03, 0x06, 0x0D, 0x87, 0x88, 0x89, 0x0E, 0x88, 0x89, 0x8A},
+	{0x81, 0x81, 0x82, 0x83, 0x84, 0x03, 0x03, 0x85, 0x03, 0x06, 0x0D, 0x87, 0x88, 0x89, 0x0E, 0x88, 0x89, 0x8A},
+	{0x81, 0x81, 0x82, 0x83, 0x8F, 0x0F, 0x0F, 0x85, 0x03, 0x90, 0x0F, 0x87, 0x88, 0x89, 0x11, 0x88, 0x89, 0x03},
+	{0x81, 0x81, 0x82, 0x83, 0x8F, 0x12, 0x03, 0x85, 0x03, 0x83, 0x13, 0x87, 0x88, 0x89, 0x14, 0x88, 0x89, 0x03},
+	{0x81, 0x81, 0x82, 0x83, 0x0F, 0x03, 0x03, 0x85, 0x03, 0x90, 0x03, 0x87, 0x88, 0x89, 0x11, 0x88, 0x89, 0x03},
+	{0x81, 0x81, 0x82, 0x83, 0x8F, 0x03, 0x03, 0x85, 0x03, 0x83, 0x13, 0x87, 0x88, 0x89, 0x14, 0x88, 0x89, 0x03},
+	{0x81, 0x81, 0x82, 0x83, 0x8F, 0x12, 0x03, 0x85, 0x03, 0x10, 0x13, 0x87, 0x88, 0x89, 0x14, 0x88, 0x89, 0x03},
+	{0x81, 0x81, 0x82, 0x83, 0x8F, 0x03, 0x03, 0x85, 0x03, 0x10, 0x13, 0x87, 0x88, 0x89, 0x14, 0x88, 0x89, 0x03},
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UCG_DFA_INCLUDED */
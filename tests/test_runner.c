@@ -4,8 +4,1161 @@
 #include <string.h>
 
 #include "../src/ucg.h"
+#include "../src/ucg_tables.h"
 #include "test_data.c"
 
+typedef struct {
+	const char* str;
+	ucg_int repeat;
+	const char* tail;
+
+	ucg_int expected_result;
+	ucg_int expected_runes;
+	ucg_int expected_clusters;
+	ucg_int expected_width;
+} long_test_case;
+
+// These are long enough to cross the vectorized paths of the decoder.
+static const long_test_case long_input_test_cases[] = {
+	{"abcdefghijklmnop", 64, "", 0, 1024, 1024, 1024},
+	{"a\xcc\x88", 100, "", 0, 200, 100, 100},
+	{"Hello, \xe4\xb8\x96\xe7\x95\x8c! ", 40, "", 0, 440, 440, 520},
+	{"abcdefghijklmnopqrstuvwxyz\r\n", 30, "", 0, 840, 810, 780},
+	{"\xd8\x80" "abcdefghijklmnopqrstuvwxyz", 10, "", 0, 270, 260, 260},
+	{"\x01" "abcdefghijklmnopqrstuvwxyz", 10, "", 0, 270, 270, 260},
+	{"\xf0\x9f\x87\xaf\xf0\x9f\x87\xb5" " ascii run ", 30, "", 0, 390, 360, 360},
+	{"0123456789", 5, "\xff", UCG_INVALID_RUNE, 50, 50, 50},
+	{"0123456789", 5, "\xe4\xb8", UCG_EXPECTED_MORE_BYTES, 50, 50, 50},
+	{"0123456789", 5, "\xe4\xb8" "abc", UCG_INVALID_RUNE, 50, 50, 50},
+	{"0123456789abcdef0123456789abcdef", 3, "\xed\xa0\x80" "abc", UCG_INVALID_RUNE, 96, 96, 96},
+};
+
+#define TABLE_LEN(t) (sizeof(t) / sizeof(ucg_rune))
+
+enum {
+	SPACING_MARK           = 1 << 0,
+	NONSPACING_MARK        = 1 << 1,
+	EXTENDED_PICTOGRAPHIC  = 1 << 2,
+	GRAPHEME_EXTEND        = 1 << 3,
+	HANGUL_SYLLABLE_LV     = 1 << 4,
+	HANGUL_SYLLABLE_LVT    = 1 << 5,
+	INCB_CONSONANT         = 1 << 6,
+	INCB_EXTEND            = 1 << 7,
+	WIDE                   = 1 << 8,
+};
+
+static uint16_t expected_properties[0x110000];
+
+static void fill_ranges(const ucg_rune* table, size_t length, size_t stride, uint16_t flag) {
+	for (size_t i = 0; i < length; i += stride) {
+		ucg_rune hi = stride == 1 ? table[i] : table[i + 1];
+		if (stride == 3 && table[i + 2] != 2) {
+			continue;
+		}
+		for (ucg_rune r = table[i]; r <= hi; r += 1) {
+			expected_properties[r] |= flag;
+		}
+	}
+}
+
+static ucg_int expected_width(ucg_rune r) {
+	if (ucg_is_control(r)) {
+		return 0;
+	} else if (r <= 0x10FF) {
+		return 1;
+	}
+
+	switch (r) {
+	case 0xFEFF:
+	case 0x200B:
+	case 0x200C:
+	case 0x200D:
+	case 0x2060:
+		return 0;
+	}
+
+	return (expected_properties[r] & WIDE) ? 2 : 1;
+}
+
+// Every property served by the lookup table is checked against the ranges in
+// `ucg_tables.h` for every codepoint.
+static ucg_int test_property_tables(void) {
+	fill_ranges(ucg_spacing_mark_ranges,                   TABLE_LEN(ucg_spacing_mark_ranges),                   2, SPACING_MARK);
+	fill_ranges(ucg_nonspacing_mark_ranges,                TABLE_LEN(ucg_nonspacing_mark_ranges),                2, NONSPACING_MARK);
+	fill_ranges(ucg_emoji_extended_pictographic_ranges,    TABLE_LEN(ucg_emoji_extended_pictographic_ranges),    2, EXTENDED_PICTOGRAPHIC);
+	fill_ranges(ucg_grapheme_extend_ranges,                TABLE_LEN(ucg_grapheme_extend_ranges),                2, GRAPHEME_EXTEND);
+	fill_ranges(ucg_hangul_syllable_lv_singlets,           TABLE_LEN(ucg_hangul_syllable_lv_singlets),           1, HANGUL_SYLLABLE_LV);
+	fill_ranges(ucg_hangul_syllable_lvt_ranges,            TABLE_LEN(ucg_hangul_syllable_lvt_ranges),            2, HANGUL_SYLLABLE_LVT);
+	fill_ranges(ucg_indic_conjunct_break_consonant_ranges, TABLE_LEN(ucg_indic_conjunct_break_consonant_ranges), 2, INCB_CONSONANT);
+	fill_ranges(ucg_indic_conjunct_break_extend_ranges,    TABLE_LEN(ucg_indic_conjunct_break_extend_ranges),    2, INCB_EXTEND);
+	fill_ranges(ucg_normalized_east_asian_width_ranges,    TABLE_LEN(ucg_normalized_east_asian_width_ranges),    3, WIDE);
+
+	ucg_int failed = 0;
+	for (ucg_rune r = 0; r <= 0x10FFFF; r += 1) {
+		uint16_t p = expected_properties[r];
+
+		bool gcb_extend  = (p & GRAPHEME_EXTEND) || ucg_is_emoji_modifier(r);
+		bool gcb_prepend = ucg_is_indic_consonant_preceding_repha(r) ||
+		                   ucg_is_indic_consonant_prefixed(r)        ||
+		                   ucg_is_prepended_concatenation_mark(r);
+
+		if (ucg_is_spacing_mark(r)                    != ((p & SPACING_MARK) != 0)          ||
+		    ucg_is_nonspacing_mark(r)                 != ((p & NONSPACING_MARK) != 0)       ||
+		    ucg_is_emoji_extended_pictographic(r)     != ((p & EXTENDED_PICTOGRAPHIC) != 0) ||
+		    ucg_is_grapheme_extend(r)                 != ((p & GRAPHEME_EXTEND) != 0)       ||
+		    ucg_is_hangul_syllable_lv(r)              != ((p & HANGUL_SYLLABLE_LV) != 0)    ||
+		    ucg_is_hangul_syllable_lvt(r)             != ((p & HANGUL_SYLLABLE_LVT) != 0)   ||
+		    ucg_is_indic_conjunct_break_consonant(r)  != ((p & INCB_CONSONANT) != 0)        ||
+		    ucg_is_indic_conjunct_break_extend(r)     != ((p & INCB_EXTEND) != 0)           ||
+		    ucg_is_gcb_extend_class(r)                != gcb_extend                         ||
+		    ucg_is_gcb_prepend_class(r)               != gcb_prepend                        ||
+		    ucg_normalized_east_asian_width(r)        != expected_width(r))
+		{
+			if (failed < 16) {
+				fprintf(stderr, "property table mismatch at U+%04lX\n", (long)r);
+			}
+			failed += 1;
+		}
+	}
+	return failed;
+}
+
+typedef struct {
+	const char* str;
+	ucg_rune expected;
+} rune_test_case;
+
+// A sequence that is cut short by anything other than a continuation byte must
+// not decode, or the runes of a piece of text would depend on what precedes it.
+static const rune_test_case rune_test_cases[] = {
+	{"a", 'a'},
+	{"\xc3\xa9", 0xE9},
+	{"\xe4\xb8\x96", 0x4E16},
+	{"\xf0\x9f\x98\x80", 0x1F600},
+	{"\xf4\x8f\xbf\xbf", 0x10FFFF},
+	{"\xc3", UCG_EXPECTED_MORE_BYTES},
+	{"\xe4\xb8", UCG_EXPECTED_MORE_BYTES},
+	{"\xf0\x9f\x98", UCG_EXPECTED_MORE_BYTES},
+	{"\xc3\x41", UCG_INVALID_RUNE},
+	{"\xc3\xc3\xa9", UCG_INVALID_RUNE},
+	{"\xe4\x41\x80", UCG_INVALID_RUNE},
+	{"\xe4\xb8\x41", UCG_INVALID_RUNE},
+	{"\xe4\xb8\xe4", UCG_INVALID_RUNE},
+	{"\xf0\x9f\x98\x41", UCG_INVALID_RUNE},
+	{"\xf0\x9f\xf0\x80", UCG_INVALID_RUNE},
+	{"\xf4\x8f\xff\xff", UCG_INVALID_RUNE},
+	{"\x80", UCG_INVALID_RUNE},
+	{"\xe0\x80\x80", UCG_INVALID_RUNE},
+	{"\xed\xa0\x80", UCG_INVALID_RUNE},
+	{"\xf4\x90\x80\x80", UCG_INVALID_RUNE},
+	{"\xff", UCG_INVALID_RUNE},
+};
+
+// Decode every sequence of three bytes, and every sequence of four led by a
+// four-byte lead, and check that whatever decodes is a valid codepoint made of
+// continuation bytes after the first.
+static ucg_int test_decode_rune_sweep(void) {
+	static const uint8_t last_bytes[] = {0x00, 0x41, 0x80, 0xBF, 0xC0, 0xFF};
+	for (ucg_int lead = 0x80; lead <= 0xFF; lead += 1) {
+		for (ucg_int second = 0; second <= 0xFF; second += 1) {
+			for (ucg_int third = 0; third <= 0xFF; third += 1) {
+				for (ucg_int last = 0; last < (ucg_int)sizeof(last_bytes); last += 1) {
+					uint8_t bytes[4] = {(uint8_t)lead, (uint8_t)second, (uint8_t)third, last_bytes[last]};
+					ucg_int length = lead >= 0xF0 ? 4 : 3;
+					if (length == 3 && last > 0) {
+						break;
+					}
+
+					ucg_int byte_iterator = 0;
+					ucg_rune r = ucg_decode_rune(bytes, length, &byte_iterator);
+					if (r < 0) {
+						continue;
+					}
+					if (r > 0x10FFFF || byte_iterator < 2) {
+						return 1;
+					}
+					for (ucg_int i = 1; i < byte_iterator; i += 1) {
+						if ((bytes[i] & 0xC0) != 0x80) {
+							return 1;
+						}
+					}
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+// Malformed sequences, each of which is placed at every offset around the
+// blocks that UTF-8 is checked in, after runes of every length and before a
+// block of ASCII.
+static const char* bad_sequences[] = {
+	"\x80", "\xbf\xbf", "\xc0\x80", "\xc1\xbf", "\xc3", "\xc3\xc3",
+	"\xe0\x80\x80", "\xe4\xb8", "\xed\xa0\x80", "\xef\xbf\xbf\xbf",
+	"\xf0\x8f\xbf\xbf", "\xf0\x9f\x98", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff",
+};
+
+#define BAD_SEQUENCE_COUNT   ((ucg_int)(sizeof(bad_sequences) / sizeof(bad_sequences[0])))
+#define BAD_SEQUENCE_OFFSETS 70
+
+static ucg_int build_bad_sequence_input(ucg_int sequence, ucg_int offset, uint8_t* buffer) {
+	static const char fill[] = "\xe4\xb8\x96" "a" "\xc3\xa9" "\xf0\x9f\x98\x80" "bc";
+	const char* bad = bad_sequences[sequence];
+
+	ucg_int buffer_len = 0;
+	while (buffer_len < offset) {
+		buffer[buffer_len] = (uint8_t)fill[buffer_len % (ucg_int)(sizeof(fill) - 1)];
+		buffer_len += 1;
+	}
+	memcpy(buffer + buffer_len, bad, strlen(bad));
+	buffer_len += (ucg_int)strlen(bad);
+	memset(buffer + buffer_len, 'x', 40);
+	buffer_len += 40;
+	memcpy(buffer + buffer_len, fill, sizeof(fill) - 1);
+	buffer_len += (ucg_int)(sizeof(fill) - 1);
+	return buffer_len;
+}
+
+static ucg_int build_long_input(long_test_case t, uint8_t* buffer) {
+	ucg_int buffer_len = 0;
+	for (ucg_int r = 0; r < t.repeat; r += 1) {
+		memcpy(buffer + buffer_len, t.str, strlen(t.str));
+		buffer_len += (ucg_int)strlen(t.str);
+	}
+	memcpy(buffer + buffer_len, t.tail, strlen(t.tail));
+	buffer_len += (ucg_int)strlen(t.tail);
+	return buffer_len;
+}
+
+// Walk the string with the iterator and check that it agrees with the
+// graphemes allocated by `ucg_decode_grapheme_clusters`.
+static ucg_int test_iterator(const uint8_t* str, ucg_int str_len) {
+	ucg_allocator allocator = ucg_default_allocator;
+	ucg_grapheme* graphemes = NULL;
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_decode_grapheme_clusters(&allocator, str, str_len, &graphemes, &rune_count, &grapheme_count, &width);
+
+	ucg_iterator it;
+	ucg_iterator_init(&it, str, str_len);
+
+	ucg_int failed = 0;
+	ucg_int i = 0;
+	ucg_int result;
+	ucg_grapheme_span g;
+	while ((result = ucg_iterator_next(&it, &g)) == 0) {
+		ucg_int next_byte_index  = i + 1 < grapheme_count ? graphemes[i + 1].byte_index : -1;
+		ucg_int next_rune_index  = i + 1 < grapheme_count ? graphemes[i + 1].rune_index : rune_count;
+		if (i >= grapheme_count ||
+		    g.byte_index != graphemes[i].byte_index ||
+		    (next_byte_index >= 0 && g.byte_index + g.byte_length != next_byte_index) ||
+		    g.rune_count != next_rune_index - graphemes[i].rune_index ||
+		    g.width != graphemes[i].width)
+		{
+			failed = 1;
+			break;
+		}
+		i += 1;
+	}
+
+	if (!failed && (i != grapheme_count || result != (expected_result == 0 ? UCG_EOF : expected_result))) {
+		failed = 1;
+	}
+
+	if (graphemes != NULL) {
+		allocator.free(graphemes, sizeof(ucg_grapheme) * (1 + grapheme_count), allocator.ctx);
+	}
+	return failed;
+}
+
+// Count every prefix of the string without an allocator, with and without the
+// width, and check the result and totals against decoding the graphemes with
+// one. Counting takes a loop of its own, so this is what keeps it honest.
+static ucg_int test_count(const uint8_t* str, ucg_int str_len) {
+	ucg_int failed = 0;
+	for (ucg_int n = 0; n <= str_len && !failed; n += 1) {
+		ucg_allocator allocator = ucg_default_allocator;
+		ucg_grapheme* graphemes = NULL;
+		ucg_int rune_count, grapheme_count, width;
+		ucg_int expected_result = ucg_decode_grapheme_clusters(&allocator, str, n, &graphemes, &rune_count, &grapheme_count, &width);
+
+		ucg_int count_runes = -1, count_graphemes = -1, count_width = -1;
+		ucg_int result = ucg_grapheme_count(str, n, &count_runes, &count_graphemes, &count_width);
+		if (result != expected_result ||
+		    count_runes != rune_count ||
+		    count_graphemes != grapheme_count ||
+		    count_width != width)
+		{
+			failed = 1;
+		}
+
+		count_runes = count_graphemes = -1;
+		result = ucg_grapheme_count(str, n, &count_runes, &count_graphemes, NULL);
+		if (result != expected_result ||
+		    count_runes != rune_count ||
+		    count_graphemes != grapheme_count)
+		{
+			failed = 1;
+		}
+
+		if (graphemes != NULL) {
+			allocator.free(graphemes, sizeof(ucg_grapheme) * (1 + grapheme_count), allocator.ctx);
+		}
+	}
+	return failed;
+}
+
+// Feed the string to a stream in chunks of every size up to 8 bytes, splitting
+// runes and graphemes along the way, and check the totals against a single
+// call over the whole string.
+static ucg_int test_stream(const uint8_t* str, ucg_int str_len) {
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_grapheme_count(str, str_len, &rune_count, &grapheme_count, &width);
+
+	for (ucg_int chunk_len = 1; chunk_len <= 8; chunk_len += 1) {
+		ucg_stream stream;
+		ucg_stream_init(&stream);
+
+		for (ucg_int i = 0; i < str_len; i += chunk_len) {
+			ucg_stream_feed(&stream, str + i, str_len - i < chunk_len ? str_len - i : chunk_len);
+		}
+
+		ucg_int stream_runes, stream_graphemes, stream_width;
+		ucg_int result = ucg_stream_finish(&stream, &stream_runes, &stream_graphemes, &stream_width);
+		if (result != expected_result ||
+		    stream_runes != rune_count ||
+		    stream_graphemes != grapheme_count ||
+		    stream_width != width)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Decode into buffers of a few small sizes, draining each one as it fills, and
+// check that the pieces add up to the graphemes allocated in one call.
+static ucg_int test_buffered(const uint8_t* str, ucg_int str_len) {
+	ucg_allocator allocator = ucg_default_allocator;
+	ucg_grapheme* graphemes = NULL;
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_decode_grapheme_clusters(&allocator, str, str_len, &graphemes, &rune_count, &grapheme_count, &width);
+
+	static const ucg_int capacities[] = {1, 2, 3, 7, 64};
+	ucg_int failed = 0;
+
+	for (size_t c = 0; c < sizeof(capacities) / sizeof(ucg_int) && !failed; c += 1) {
+		ucg_cursor cursor;
+		ucg_cursor_init(&cursor);
+
+		ucg_grapheme buffer[64];
+		ucg_int drained = 0;
+		ucg_int result, written, buffered_runes, buffered_graphemes, buffered_width;
+		do {
+			result = ucg_decode_grapheme_clusters_into(&cursor, str, str_len, buffer, capacities[c], &written, &buffered_runes, &buffered_graphemes, &buffered_width);
+			if (drained + written > grapheme_count ||
+			    (written > 0 && memcmp(buffer, graphemes + drained, sizeof(ucg_grapheme) * written) != 0))
+			{
+				failed = 1;
+				break;
+			}
+			drained += written;
+		} while (result == UCG_BUFFER_FULL);
+
+		if (result != expected_result ||
+		    drained != grapheme_count ||
+		    buffered_runes != rune_count ||
+		    buffered_graphemes != grapheme_count ||
+		    buffered_width != width)
+		{
+			failed = 1;
+		}
+	}
+
+	if (graphemes != NULL) {
+		allocator.free(graphemes, sizeof(ucg_grapheme) * (1 + grapheme_count), allocator.ctx);
+	}
+	return failed;
+}
+
+// Decode every combination of columns and check them against the graphemes
+// allocated in one call. The UTF-16 index of each rune is found by decoding the
+// runes one at a time.
+static ucg_int test_columns(const uint8_t* str, ucg_int str_len) {
+	ucg_allocator allocator = ucg_default_allocator;
+	ucg_grapheme* graphemes = NULL;
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_decode_grapheme_clusters(&allocator, str, str_len, &graphemes, &rune_count, &grapheme_count, &width);
+
+	static uint32_t rune_utf16_indices[4096];
+	if (rune_count > (ucg_int)(sizeof(rune_utf16_indices) / sizeof(rune_utf16_indices[0]))) {
+		if (graphemes != NULL) {
+			allocator.free(graphemes, sizeof(ucg_grapheme) * (1 + grapheme_count), allocator.ctx);
+		}
+		return 1;
+	}
+	ucg_int byte_iterator = 0;
+	ucg_int utf16_index = 0;
+	for (ucg_int i = 0; i < rune_count; i += 1) {
+		rune_utf16_indices[i] = (uint32_t)utf16_index;
+		utf16_index += ucg_decode_rune(str, str_len, &byte_iterator) > 0xFFFF ? 2 : 1;
+	}
+
+	ucg_int failed = 0;
+
+	for (ucg_int fields = 1; fields <= (UCG_FIELD_BYTE_INDEX | UCG_FIELD_RUNE_INDEX | UCG_FIELD_WIDTH | UCG_FIELD_UTF16_INDEX) && !failed; fields += 1) {
+		uint32_t byte_indices[5];
+		uint32_t rune_indices[5];
+		uint8_t  widths[5];
+		uint32_t utf16_indices[5];
+		ucg_grapheme_columns columns = {
+			fields,
+			fields & UCG_FIELD_BYTE_INDEX  ? byte_indices  : NULL,
+			fields & UCG_FIELD_RUNE_INDEX  ? rune_indices  : NULL,
+			fields & UCG_FIELD_WIDTH       ? widths        : NULL,
+			fields & UCG_FIELD_UTF16_INDEX ? utf16_indices : NULL,
+		};
+
+		ucg_cursor cursor;
+		ucg_cursor_init(&cursor);
+
+		ucg_int drained = 0;
+		ucg_int result, written, column_runes, column_graphemes, column_width;
+		do {
+			result = ucg_decode_grapheme_columns(&cursor, str, str_len, &columns, 5, &written, &column_runes, &column_graphemes, &column_width);
+			for (ucg_int i = 0; i < written && !failed; i += 1) {
+				if (drained + i >= grapheme_count) {
+					failed = 1;
+					break;
+				}
+				ucg_grapheme g = graphemes[drained + i];
+				if (((fields & UCG_FIELD_BYTE_INDEX)  && byte_indices[i]  != (uint32_t)g.byte_index) ||
+				    ((fields & UCG_FIELD_RUNE_INDEX)  && rune_indices[i]  != (uint32_t)g.rune_index) ||
+				    ((fields & UCG_FIELD_WIDTH)       && widths[i]        != (uint8_t)g.width) ||
+				    ((fields & UCG_FIELD_UTF16_INDEX) && (g.rune_index < 0 || g.rune_index >= rune_count ||
+				                                          utf16_indices[i] != rune_utf16_indices[g.rune_index])))
+				{
+					failed = 1;
+				}
+			}
+			drained += written;
+		} while (result == UCG_BUFFER_FULL && !failed);
+
+		if (result != expected_result ||
+		    drained != grapheme_count ||
+		    column_runes != rune_count ||
+		    column_graphemes != grapheme_count ||
+		    column_width != width)
+		{
+			failed = 1;
+		}
+	}
+
+	if (graphemes != NULL) {
+		allocator.free(graphemes, sizeof(ucg_grapheme) * (1 + grapheme_count), allocator.ctx);
+	}
+	return failed;
+}
+
+// Decode runes and graphemes together with buffers of several sizes for each,
+// and check them against `ucg_decode_rune` and the allocated graphemes.
+static ucg_int test_runes_and_graphemes(const uint8_t* str, ucg_int str_len) {
+	ucg_allocator allocator = ucg_default_allocator;
+	ucg_grapheme* graphemes = NULL;
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_decode_grapheme_clusters(&allocator, str, str_len, &graphemes, &rune_count, &grapheme_count, &width);
+
+	static uint32_t expected_runes[4096];
+	ucg_int byte_iterator = 0;
+	for (ucg_int i = 0; i < rune_count; i += 1) {
+		expected_runes[i] = (uint32_t)ucg_decode_rune(str, str_len, &byte_iterator);
+	}
+
+	ucg_int failed = 0;
+
+	static const ucg_int rune_capacities[] = {1, 2, 7, 4096};
+	static const ucg_int grapheme_capacities[] = {1, 3, 4096};
+	for (ucg_int r = 0; r < (ucg_int)(sizeof(rune_capacities) / sizeof(rune_capacities[0])) && !failed; r += 1) {
+		for (ucg_int g = 0; g < (ucg_int)(sizeof(grapheme_capacities) / sizeof(grapheme_capacities[0])) && !failed; g += 1) {
+			static uint32_t runes[4096];
+			static uint32_t byte_indices[4096];
+			static uint32_t rune_indices[4096];
+			ucg_grapheme_columns columns = {UCG_FIELD_BYTE_INDEX | UCG_FIELD_RUNE_INDEX, byte_indices, rune_indices, NULL, NULL};
+
+			ucg_cursor cursor;
+			ucg_cursor_init(&cursor);
+
+			ucg_int runes_drained = 0;
+			ucg_int drained = 0;
+			ucg_int result, runes_written, written, total_runes, total_graphemes, total_width;
+			do {
+				result = ucg_decode_runes_and_graphemes(&cursor, str, str_len,
+					runes, rune_capacities[r], &runes_written,
+					&columns, grapheme_capacities[g], &written,
+					&total_runes, &total_graphemes, &total_width);
+
+				if (runes_drained + runes_written > rune_count ||
+				    total_runes != runes_drained + runes_written ||
+				    memcmp(runes, expected_runes + runes_drained, sizeof(uint32_t) * (size_t)runes_written) != 0)
+				{
+					failed = 1;
+				}
+				for (ucg_int i = 0; i < written && !failed; i += 1) {
+					if (drained + i >= grapheme_count ||
+					    byte_indices[i] != (uint32_t)graphemes[drained + i].byte_index ||
+					    rune_indices[i] != (uint32_t)graphemes[drained + i].rune_index)
+					{
+						failed = 1;
+					}
+				}
+				runes_drained += runes_written;
+				drained += written;
+			} while (result == UCG_BUFFER_FULL && !failed);
+
+			if (result != expected_result ||
+			    runes_drained != rune_count ||
+			    drained != grapheme_count ||
+			    total_graphemes != grapheme_count ||
+			    total_width != width)
+			{
+				failed = 1;
+			}
+		}
+	}
+
+	if (graphemes != NULL) {
+		allocator.free(graphemes, sizeof(ucg_grapheme) * (1 + grapheme_count), allocator.ctx);
+	}
+	return failed;
+}
+
+// Transcode the valid part of the string to UTF-16 and UTF-32, and check that
+// it segments the same way in each, with offsets in code units.
+static ucg_int test_utf16_utf32(const uint8_t* str, ucg_int str_len) {
+	static uint16_t utf16[4096 * 2];
+	static uint32_t utf32[4096];
+	static ucg_int utf16_offsets[4096 + 1];
+	static ucg_int utf32_offsets[4096 + 1];
+
+	// Each byte offset where a rune begins is mapped to its offset in code units.
+	ucg_int utf16_len = 0;
+	ucg_int utf32_len = 0;
+	ucg_int byte_index = 0;
+	while (byte_index < str_len) {
+		ucg_int rune_start = byte_index;
+		ucg_rune r = ucg_decode_rune(str, str_len, &byte_index);
+		if (r < 0) {
+			byte_index = rune_start;
+			break;
+		}
+		utf16_offsets[rune_start] = utf16_len;
+		utf32_offsets[rune_start] = utf32_len;
+
+		if (r >= 0x10000) {
+			utf16[utf16_len]     = (uint16_t)(0xD800 + ((r - 0x10000) >> 10));
+			utf16[utf16_len + 1] = (uint16_t)(0xDC00 + ((r - 0x10000) & 0x3FF));
+			utf16_len += 2;
+		} else {
+			utf16[utf16_len] = (uint16_t)r;
+			utf16_len += 1;
+		}
+		utf32[utf32_len] = (uint32_t)r;
+		utf32_len += 1;
+	}
+	ucg_int valid_len = byte_index;
+
+	ucg_allocator allocator = ucg_default_allocator;
+	ucg_grapheme* expected = NULL;
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_decode_grapheme_clusters(&allocator, str, valid_len, &expected, &rune_count, &grapheme_count, &width);
+
+	ucg_grapheme* graphemes_16 = NULL;
+	ucg_grapheme* graphemes_32 = NULL;
+	ucg_int runes_16, count_16, width_16;
+	ucg_int runes_32, count_32, width_32;
+	ucg_int result_16 = ucg_decode_grapheme_clusters_utf16(&allocator, utf16, utf16_len, &graphemes_16, &runes_16, &count_16, &width_16);
+	ucg_int result_32 = ucg_decode_grapheme_clusters_utf32(&allocator, utf32, utf32_len, &graphemes_32, &runes_32, &count_32, &width_32);
+
+	ucg_int failed = 0;
+	if (result_16 != expected_result || runes_16 != rune_count || count_16 != grapheme_count || width_16 != width ||
+	    result_32 != expected_result || runes_32 != rune_count || count_32 != grapheme_count || width_32 != width)
+	{
+		failed = 1;
+	}
+	for (ucg_int i = 0; i < grapheme_count && !failed; i += 1) {
+		ucg_grapheme g = expected[i];
+		if (graphemes_16[i].byte_index != utf16_offsets[g.byte_index] || graphemes_16[i].rune_index != g.rune_index || graphemes_16[i].width != g.width ||
+		    graphemes_32[i].byte_index != utf32_offsets[g.byte_index] || graphemes_32[i].rune_index != g.rune_index || graphemes_32[i].width != g.width)
+		{
+			failed = 1;
+		}
+	}
+
+	if (expected != NULL) {
+		allocator.free(expected, sizeof(ucg_grapheme) * (1 + grapheme_count), allocator.ctx);
+	}
+	if (graphemes_16 != NULL) {
+		allocator.free(graphemes_16, sizeof(ucg_grapheme) * (1 + count_16), allocator.ctx);
+	}
+	if (graphemes_32 != NULL) {
+		allocator.free(graphemes_32, sizeof(ucg_grapheme) * (1 + count_32), allocator.ctx);
+	}
+	return failed;
+}
+
+// Check that exactly the bytes where the allocated graphemes begin are marked.
+static ucg_int test_boundaries(const uint8_t* str, ucg_int str_len) {
+	ucg_allocator allocator = ucg_default_allocator;
+	ucg_grapheme* graphemes = NULL;
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_decode_grapheme_clusters(&allocator, str, str_len, &graphemes, &rune_count, &grapheme_count, &width);
+
+	uint8_t expected[4096 / 8 + 1] = {0};
+	for (ucg_int i = 0; i < grapheme_count; i += 1) {
+		expected[graphemes[i].byte_index / 8] |= (uint8_t)(1 << (graphemes[i].byte_index % 8));
+	}
+
+	uint8_t boundaries[4096 / 8 + 1];
+	memset(boundaries, 0xAA, sizeof(boundaries));
+
+	ucg_int bitmap_runes, bitmap_graphemes, bitmap_width;
+	ucg_int result = ucg_decode_grapheme_boundaries(str, str_len, boundaries, &bitmap_runes, &bitmap_graphemes, &bitmap_width);
+
+	ucg_int failed = 0;
+	if (result != expected_result ||
+	    memcmp(boundaries, expected, (size_t)((str_len + 7) / 8)) != 0 ||
+	    bitmap_runes != rune_count ||
+	    bitmap_graphemes != grapheme_count ||
+	    bitmap_width != width)
+	{
+		failed = 1;
+	}
+
+	if (graphemes != NULL) {
+		allocator.free(graphemes, sizeof(ucg_grapheme) * (1 + grapheme_count), allocator.ctx);
+	}
+	return failed;
+}
+
+// Walk the string backwards and check that the graphemes come out as the
+// forward iterator's in reverse, and that the previous boundary is right for
+// every offset into the string.
+static ucg_int test_reverse(const uint8_t* str, ucg_int str_len) {
+	static ucg_grapheme_span forward[4096];
+	ucg_int count = 0;
+
+	ucg_iterator it;
+	ucg_iterator_init(&it, str, str_len);
+	while (ucg_iterator_next(&it, &forward[count]) == 0) {
+		count += 1;
+	}
+
+	ucg_reverse_iterator rit;
+	ucg_reverse_iterator_init(&rit, str, str_len);
+
+	ucg_grapheme_span g;
+	for (ucg_int i = count - 1; i >= 0; i -= 1) {
+		if (ucg_reverse_iterator_prev(&rit, &g) != 0 ||
+		    g.byte_index != forward[i].byte_index ||
+		    g.byte_length != forward[i].byte_length ||
+		    g.rune_count != forward[i].rune_count ||
+		    g.width != forward[i].width)
+		{
+			return 1;
+		}
+	}
+	if (ucg_reverse_iterator_prev(&rit, &g) != UCG_EOF) {
+		return 1;
+	}
+
+	ucg_int i = 0;
+	for (ucg_int offset = 0; offset <= str_len; offset += 1) {
+		while (i < count && forward[i].byte_index < offset) {
+			i += 1;
+		}
+		ucg_int expected = i == 0 ? UCG_EOF : forward[i - 1].byte_index;
+		if (ucg_prev_grapheme_boundary(str, str_len, offset) != expected) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// These repeat into text where no rune leaves the decoder in a known state for
+// a long way back.
+static const char* lookback_test_units[] = {
+	"\xf0\x9f\x98\x80",
+	"\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7",
+	"\xf0\x9f\x91\x8b\xf0\x9f\x8f\xbd",
+	"a\xcc\x88\xcc\x81",
+	"\xe0\xa4\x95\xe0\xa5\x8d\xe0\xa4\xb7",
+	"\xd8\x80" "a",
+	"\xf0\x9f\x87\xaf\xf0\x9f\x87\xb5 ",
+	"\xe1\x84\x80\xe1\x85\xa1\xe1\x86\xa8",
+};
+
+// Check that finding the previous boundary, or the grapheme around an offset,
+// reads only a bounded amount of text before it. The text begins with a byte
+// that is not UTF-8, so reading back as far as that would fail.
+static ucg_int test_bounded_lookback(const char* unit) {
+	static uint8_t buffer[4096];
+	ucg_int unit_len = (ucg_int)strlen(unit);
+	ucg_int buffer_len = 1;
+	buffer[0] = 0xFF;
+	while (buffer_len + unit_len <= (ucg_int)sizeof(buffer)) {
+		memcpy(buffer + buffer_len, unit, (size_t)unit_len);
+		buffer_len += unit_len;
+	}
+
+	ucg_iterator it;
+	ucg_iterator_init(&it, buffer + 1, buffer_len - 1);
+
+	ucg_grapheme_span g;
+	while (ucg_iterator_next(&it, &g) == 0) {
+		if (g.byte_index < 256) {
+			continue;
+		}
+		if (ucg_prev_grapheme_boundary(buffer, buffer_len, 1 + g.byte_index + g.byte_length) != 1 + g.byte_index) {
+			return 1;
+		}
+		for (ucg_int offset = g.byte_index; offset < g.byte_index + g.byte_length; offset += 1) {
+			if (ucg_find_boundary_at(buffer, buffer_len, 1 + offset) != 1 + g.byte_index) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+// Check that the grapheme found for every byte of the string is the one that
+// the forward iterator says contains it.
+static ucg_int test_find_boundary(const uint8_t* str, ucg_int str_len) {
+	ucg_iterator it;
+	ucg_iterator_init(&it, str, str_len);
+
+	ucg_grapheme_span g;
+	while (ucg_iterator_next(&it, &g) == 0) {
+		for (ucg_int offset = g.byte_index; offset < g.byte_index + g.byte_length; offset += 1) {
+			if (ucg_find_boundary_at(str, str_len, offset) != g.byte_index) {
+				return 1;
+			}
+		}
+	}
+	return ucg_find_boundary_at(str, str_len, str_len) == UCG_EOF ? 0 : 1;
+}
+
+// Check that segmenting on any number of threads gives the same graphemes as
+// one pass on the calling thread.
+static ucg_int test_parallel(const uint8_t* str, ucg_int str_len) {
+	ucg_allocator allocator = ucg_default_allocator;
+	ucg_grapheme* graphemes = NULL;
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_decode_grapheme_clusters(&allocator, str, str_len, &graphemes, &rune_count, &grapheme_count, &width);
+
+	ucg_int failed = 0;
+	for (ucg_int thread_count = 1; thread_count <= 8 && !failed; thread_count += 1) {
+		ucg_grapheme* parallel_graphemes = NULL;
+		ucg_int parallel_runes, parallel_grapheme_count, parallel_width;
+		ucg_int result = ucg_decode_grapheme_clusters_parallel(&allocator, str, str_len, thread_count, &parallel_graphemes, &parallel_runes, &parallel_grapheme_count, &parallel_width);
+
+		if (result != expected_result ||
+		    parallel_runes != rune_count ||
+		    parallel_grapheme_count != grapheme_count ||
+		    parallel_width != width ||
+		    memcmp(parallel_graphemes, graphemes, sizeof(ucg_grapheme) * grapheme_count) != 0)
+		{
+			failed = 1;
+		}
+
+		allocator.free(parallel_graphemes, sizeof(ucg_grapheme) * (1 + parallel_grapheme_count), allocator.ctx);
+	}
+
+	allocator.free(graphemes, sizeof(ucg_grapheme) * (1 + grapheme_count), allocator.ctx);
+	return failed;
+}
+
+// Cut the string in two and in three at every offset, merging the summaries of
+// the pieces both ways round, and check that it always comes to the summary of
+// the whole string, with the same totals as a single call.
+static ucg_int test_summary(const uint8_t* str, ucg_int str_len) {
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_grapheme_count(str, str_len, &rune_count, &grapheme_count, &width);
+
+	ucg_summary whole;
+	ucg_summarize(str, str_len, &whole);
+
+	ucg_int summary_runes, summary_graphemes, summary_width;
+	if (ucg_summary_totals(&whole, &summary_runes, &summary_graphemes, &summary_width) != expected_result ||
+	    summary_runes != rune_count ||
+	    summary_graphemes != grapheme_count ||
+	    summary_width != width)
+	{
+		return 1;
+	}
+
+	for (ucg_int i = 0; i <= str_len; i += 1) {
+		ucg_int j = i + (str_len - i) / 2;
+
+		ucg_summary a, b, c, left, right;
+		ucg_summarize(str, i, &a);
+		ucg_summarize(str + i, j - i, &b);
+		ucg_summarize(str + j, str_len - j, &c);
+
+		ucg_summary_merge(&a, &b, &left);
+		ucg_summary_merge(&left, &c, &left);
+		ucg_summary_merge(&b, &c, &right);
+		ucg_summary_merge(&a, &right, &right);
+
+		if (memcmp(&left, &whole, sizeof(whole)) != 0 || memcmp(&right, &whole, sizeof(whole)) != 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Fit the string into every width up to a little past its own, with and without
+// room for an ellipsis, and check where it is cut against the graphemes found
+// by the iterator.
+static ucg_int test_truncate(const uint8_t* str, ucg_int str_len) {
+	static ucg_grapheme_span graphemes[4096];
+	ucg_int count = 0;
+	ucg_int total_width = 0;
+
+	ucg_iterator it;
+	ucg_iterator_init(&it, str, str_len);
+	while (ucg_iterator_next(&it, &graphemes[count]) == 0) {
+		total_width += graphemes[count].width;
+		count += 1;
+	}
+
+	for (ucg_int max_width = 0; max_width <= total_width + 2; max_width += 1) {
+		for (ucg_int ellipsis_width = 0; ellipsis_width <= 2; ellipsis_width += 1) {
+			ucg_int expected_bytes = str_len;
+			ucg_int expected_width = total_width;
+			if (total_width > max_width) {
+				expected_bytes = 0;
+				expected_width = 0;
+				for (ucg_int i = 0; i < count && expected_width + graphemes[i].width <= max_width - ellipsis_width; i += 1) {
+					expected_width += graphemes[i].width;
+					expected_bytes = graphemes[i].byte_index + graphemes[i].byte_length;
+				}
+			}
+
+			ucg_int byte_length, width;
+			if (ucg_truncate_to_width(str, str_len, max_width, ellipsis_width, &byte_length, &width) != 0 ||
+			    byte_length != expected_bytes ||
+			    width != expected_width)
+			{
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+// Wrap the string to a few widths, draining the offsets through buffers of a
+// few sizes, and check them against lines laid out from the iterator.
+static ucg_int test_wrap(const uint8_t* str, ucg_int str_len) {
+	static ucg_grapheme_span graphemes[4096];
+	ucg_int count = 0;
+
+	ucg_iterator it;
+	ucg_iterator_init(&it, str, str_len);
+	ucg_int expected_result;
+	while ((expected_result = ucg_iterator_next(&it, &graphemes[count])) == 0) {
+		count += 1;
+	}
+	if (expected_result == UCG_EOF) {
+		expected_result = 0;
+	}
+
+	static const ucg_int widths[] = {1, 2, 3, 7, 80};
+	static const ucg_int capacities[] = {1, 2, 64};
+	for (ucg_int w = 0; w < (ucg_int)(sizeof(widths) / sizeof(widths[0])); w += 1) {
+		static ucg_int expected[4096];
+		ucg_int expected_count = 0;
+		ucg_int line_width = 0;
+		for (ucg_int i = 0; i < count; i += 1) {
+			if (line_width > 0 && line_width + graphemes[i].width > widths[w]) {
+				expected[expected_count] = graphemes[i].byte_index;
+				expected_count += 1;
+				line_width = 0;
+			}
+			line_width += graphemes[i].width;
+		}
+
+		for (ucg_int c = 0; c < (ucg_int)(sizeof(capacities) / sizeof(capacities[0])); c += 1) {
+			ucg_wrapper wrapper;
+			ucg_wrapper_init(&wrapper, widths[w]);
+
+			ucg_int offsets[64];
+			ucg_int total = 0;
+			ucg_int written;
+			ucg_int result;
+			do {
+				result = ucg_wrap_to_width(&wrapper, str, str_len, offsets, capacities[c], &written);
+				if (total + written > expected_count ||
+				    memcmp(offsets, expected + total, sizeof(ucg_int) * written) != 0)
+				{
+					return 1;
+				}
+				total += written;
+			} while (result == UCG_BUFFER_FULL);
+
+			if (result != expected_result || total != expected_count) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+// Index the string with a few intervals, and look up every grapheme by its
+// number, by each of its bytes, and by each column it covers.
+static ucg_int test_column_index(const uint8_t* str, ucg_int str_len) {
+	static ucg_grapheme_span graphemes[4096];
+	ucg_int count = 0;
+
+	ucg_iterator it;
+	ucg_iterator_init(&it, str, str_len);
+	while (ucg_iterator_next(&it, &graphemes[count]) == 0) {
+		count += 1;
+	}
+
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_grapheme_count(str, str_len, &rune_count, &grapheme_count, &width);
+
+	ucg_allocator allocator = ucg_default_allocator;
+	static const ucg_int intervals[] = {1, 3, 64};
+	for (ucg_int n = 0; n < (ucg_int)(sizeof(intervals) / sizeof(intervals[0])); n += 1) {
+		ucg_column_index index;
+		ucg_int result = ucg_column_index_build(&allocator, str, str_len, intervals[n], &index);
+
+		ucg_int failed = result != expected_result ||
+		                 index.rune_count != rune_count ||
+		                 index.grapheme_count != grapheme_count ||
+		                 index.width != width;
+
+		ucg_int rune_index = 0;
+		ucg_int column = 0;
+		for (ucg_int i = 0; i < count && !failed; i += 1) {
+			ucg_column_position p;
+			ucg_column_position expected = {graphemes[i].byte_index, graphemes[i].byte_length, rune_index, i, column, graphemes[i].width};
+
+			failed |= ucg_column_index_find_grapheme(&index, i, &p) != 0 || memcmp(&p, &expected, sizeof(p)) != 0;
+			for (ucg_int b = 0; b < graphemes[i].byte_length; b += 1) {
+				failed |= ucg_column_index_find_byte(&index, graphemes[i].byte_index + b, &p) != 0 || memcmp(&p, &expected, sizeof(p)) != 0;
+			}
+			for (ucg_int c = 0; c < graphemes[i].width; c += 1) {
+				failed |= ucg_column_index_find_column(&index, column + c, &p) != 0 || memcmp(&p, &expected, sizeof(p)) != 0;
+			}
+
+			rune_index += graphemes[i].rune_count;
+			column += graphemes[i].width;
+		}
+
+		ucg_column_position p;
+		failed |= ucg_column_index_find_grapheme(&index, count, &p) != UCG_EOF ||
+		          ucg_column_index_find_column(&index, column, &p) != UCG_EOF ||
+		          ucg_column_index_find_byte(&index, str_len, &p) != UCG_EOF;
+
+		ucg_column_index_destroy(&allocator, &index);
+		if (failed) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Check a segmentation against one pass over the string it was edited into.
+static ucg_int check_segmentation(const ucg_segmentation* segmentation, const uint8_t* str, ucg_int str_len) {
+	ucg_allocator allocator = ucg_default_allocator;
+	ucg_grapheme* graphemes = NULL;
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int expected_result = ucg_decode_grapheme_clusters(&allocator, str, str_len, &graphemes, &rune_count, &grapheme_count, &width);
+
+	ucg_int edited_runes, edited_graphemes, edited_width;
+	ucg_int failed = ucg_segmentation_totals(segmentation, &edited_runes, &edited_graphemes, &edited_width) != expected_result ||
+	                 edited_runes != rune_count ||
+	                 edited_graphemes != grapheme_count ||
+	                 edited_width != width;
+
+	for (ucg_int i = 0; i < grapheme_count && !failed; i += 1) {
+		ucg_grapheme g;
+		failed = ucg_segmentation_grapheme(segmentation, i, &g) != 0 || memcmp(&g, &graphemes[i], sizeof(g)) != 0;
+	}
+	if (!failed) {
+		ucg_grapheme g;
+		failed = ucg_segmentation_grapheme(segmentation, grapheme_count, &g) != UCG_EOF;
+	}
+
+	allocator.free(graphemes, sizeof(ucg_grapheme) * (1 + grapheme_count), allocator.ctx);
+	return failed;
+}
+
+// Edit the string at a spread of offsets, putting in a combining mark, a
+// regional indicator and a stray byte and taking each out again, and check the
+// segmentation after every edit.
+static ucg_int test_segmentation(const uint8_t* str, ucg_int str_len) {
+	static const char* insertions[] = {"\xcc\x88", "\xf0\x9f\x87\xaf", "\x80", "a\r"};
+
+	ucg_allocator allocator = ucg_default_allocator;
+	ucg_segmentation segmentation;
+	ucg_segmentation_build(&allocator, str, str_len, &segmentation);
+
+	static uint8_t edited[4096 + 8];
+	ucg_int failed = check_segmentation(&segmentation, str, str_len);
+	ucg_int stride = str_len < 64 ? 1 : 37;
+
+	for (ucg_int i = 0; i <= str_len && !failed; i += stride) {
+		for (ucg_int n = 0; n < (ucg_int)(sizeof(insertions) / sizeof(insertions[0])) && !failed; n += 1) {
+			ucg_int inserted_len = (ucg_int)strlen(insertions[n]);
+			memcpy(edited, str, (size_t)i);
+			memcpy(edited + i, insertions[n], (size_t)inserted_len);
+			memcpy(edited + i + inserted_len, str + i, (size_t)(str_len - i));
+
+			ucg_segmentation_edit(&allocator, &segmentation, edited, str_len + inserted_len, i, 0, inserted_len);
+			failed |= check_segmentation(&segmentation, edited, str_len + inserted_len);
+
+			ucg_segmentation_edit(&allocator, &segmentation, str, str_len, i, inserted_len, 0);
+			failed |= check_segmentation(&segmentation, str, str_len);
+		}
+
+		// Replace a byte with another, which may cut a rune in two.
+		if (i < str_len && !failed) {
+			memcpy(edited, str, (size_t)str_len);
+			edited[i] = 'x';
+
+			ucg_segmentation_edit(&allocator, &segmentation, edited, str_len, i, 1, 1);
+			failed |= check_segmentation(&segmentation, edited, str_len);
+
+			ucg_segmentation_edit(&allocator, &segmentation, str, str_len, i, 1, 1);
+			failed |= check_segmentation(&segmentation, str, str_len);
+		}
+	}
+
+	ucg_segmentation_destroy(&allocator, &segmentation);
+	return failed;
+}
+
+// Count with every grapheme limit and every width limit up to a little past
+// the string's own, and check where it stops against the iterator.
+static ucg_int test_limited(const uint8_t* str, ucg_int str_len) {
+	static ucg_grapheme_span graphemes[4096];
+	ucg_int count = 0;
+	ucg_int total_width = 0;
+
+	ucg_iterator it;
+	ucg_iterator_init(&it, str, str_len);
+	while (ucg_iterator_next(&it, &graphemes[count]) == 0) {
+		total_width += graphemes[count].width;
+		count += 1;
+	}
+
+	ucg_int rune_count, grapheme_count, width;
+	ucg_int full_result = ucg_grapheme_count(str, str_len, &rune_count, &grapheme_count, &width);
+
+	for (ucg_int max_graphemes = -1; max_graphemes <= count + 1; max_graphemes += 1) {
+		for (ucg_int max_width = -1; max_width <= total_width + 1; max_width += 1) {
+			ucg_int expected_result = full_result;
+			ucg_int expected_byte_index = str_len;
+			ucg_int expected_runes = rune_count;
+			ucg_int expected_graphemes = grapheme_count;
+			ucg_int expected_width = width;
+
+			ucg_int runes = 0;
+			ucg_int columns = 0;
+			for (ucg_int i = 0; i < count; i += 1) {
+				if ((max_graphemes >= 0 && i >= max_graphemes) ||
+				    (max_width >= 0 && columns + graphemes[i].width > max_width))
+				{
+					expected_result = UCG_LIMIT_REACHED;
+					expected_byte_index = graphemes[i].byte_index;
+					expected_runes = runes;
+					expected_graphemes = i;
+					expected_width = columns;
+					break;
+				}
+				runes += graphemes[i].rune_count;
+				columns += graphemes[i].width;
+			}
+
+			ucg_int byte_index, limited_runes, limited_graphemes, limited_width;
+			ucg_int result = ucg_grapheme_count_limited(str, str_len, max_graphemes, max_width, &byte_index, &limited_runes, &limited_graphemes, &limited_width);
+			if (result != expected_result ||
+			    (result <= 0 && result != UCG_INVALID_RUNE && result != UCG_EXPECTED_MORE_BYTES && byte_index != expected_byte_index) ||
+			    limited_runes != expected_runes ||
+			    limited_graphemes != expected_graphemes ||
+			    limited_width != expected_width)
+			{
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+// Count the runes alone in every prefix of the string, which cuts runes short
+// at every point, and check them against a full count.
+static ucg_int test_rune_count(const uint8_t* str, ucg_int str_len) {
+	for (ucg_int n = 0; n <= str_len; n += 1) {
+		ucg_int expected_runes, grapheme_count;
+		ucg_int expected_result = ucg_grapheme_count(str, n, &expected_runes, &grapheme_count, NULL);
+
+		ucg_int rune_count;
+		ucg_int result = ucg_grapheme_count(str, n, &rune_count, NULL, NULL);
+		if (result != expected_result || rune_count != expected_runes) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Decode the runes in bulk with buffers of several sizes, continuing whenever
+// one fills up, and check them against `ucg_decode_rune`.
+static ucg_int test_decode_runes(const uint8_t* str, ucg_int str_len) {
+	static uint32_t expected[4096];
+	ucg_int expected_count = 0;
+	ucg_int expected_result = 0;
+	ucg_int expected_consumed = 0;
+	while (expected_consumed < str_len) {
+		ucg_int byte_iterator = expected_consumed;
+		ucg_rune r = ucg_decode_rune(str, str_len, &byte_iterator);
+		if (r < 0) {
+			expected_result = r;
+			break;
+		}
+		expected[expected_count] = (uint32_t)r;
+		expected_count += 1;
+		expected_consumed = byte_iterator;
+	}
+
+	static const ucg_int capacities[] = {1, 3, 33, 4096};
+	for (ucg_int c = 0; c < (ucg_int)(sizeof(capacities) / sizeof(capacities[0])); c += 1) {
+		static uint32_t runes[4096];
+		ucg_int count = 0;
+		ucg_int consumed = 0;
+		ucg_int result;
+		do {
+			ucg_int chunk_consumed, written;
+			result = ucg_decode_runes(str + consumed, str_len - consumed, runes + count, capacities[c], &chunk_consumed, &written);
+			if (written > capacities[c] || (result == UCG_BUFFER_FULL && written != capacities[c])) {
+				return 1;
+			}
+			consumed += chunk_consumed;
+			count += written;
+		} while (result == UCG_BUFFER_FULL);
+
+		if (result != expected_result ||
+		    consumed != expected_consumed ||
+		    count != expected_count ||
+		    memcmp(runes, expected, sizeof(uint32_t) * (size_t)count) != 0)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
 int main(int argc, const char** argv) {
     (void)argc;
     (void)argv;
@@ -44,6 +1197,582 @@ int main(int argc, const char** argv) {
 		completed += 1;
 	}
 
+	printf("Running rune decoder tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(rune_test_cases) / sizeof(rune_test_case)); i += 1) {
+		rune_test_case t = rune_test_cases[i];
+		ucg_int byte_iterator = 0;
+		ucg_rune r = ucg_decode_rune((const uint8_t*)t.str, (ucg_int)strlen(t.str), &byte_iterator);
+		if (r != t.expected || (r >= 0 && byte_iterator != (ucg_int)strlen(t.str))) {
+			fprintf(stderr, "(#% 4li) decoded rune: %li != %li\n", i, r, t.expected);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	if (test_decode_rune_sweep() != 0) {
+		fprintf(stderr, "decoded a malformed sequence of bytes\n");
+		failed += 1;
+	}
+	completed += 1;
+
+	printf("Running long input tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		long_test_case t = long_input_test_cases[i];
+
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(t, buffer);
+
+		ucg_int rune_count, grapheme_count, width;
+		ucg_int result = ucg_grapheme_count(buffer, buffer_len, &rune_count, &grapheme_count, &width);
+		if (result != t.expected_result ||
+		    rune_count != t.expected_runes ||
+		    grapheme_count != t.expected_clusters ||
+		    width != t.expected_width)
+		{
+			fprintf(stderr, "(#% 4li) long input: result %li, runes %li, graphemes %li, width %li\n", i, result, rune_count, grapheme_count, width);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running count tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_count((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) count disagrees with decoder: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_count(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) count disagrees with decoder on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int b = 0; b < BAD_SEQUENCE_COUNT; b += 1) {
+		for (ucg_int offset = 0; offset < BAD_SEQUENCE_OFFSETS; offset += 1) {
+			uint8_t buffer[256];
+			ucg_int buffer_len = build_bad_sequence_input(b, offset, buffer);
+			if (test_count(buffer, buffer_len) != 0) {
+				fprintf(stderr, "(#% 4li) count disagrees with decoder after %li bytes of malformed input\n", b, offset);
+				failed += 1;
+			}
+			completed += 1;
+		}
+	}
+
+	printf("Running iterator tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_iterator((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) iterator disagrees with decoder: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_iterator(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) iterator disagrees with decoder on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	// The iterator decodes one rune at a time, so it also checks the blocks
+	// that the decoder reads malformed text in.
+	for (ucg_int b = 0; b < BAD_SEQUENCE_COUNT; b += 1) {
+		for (ucg_int offset = 0; offset < BAD_SEQUENCE_OFFSETS; offset += 1) {
+			uint8_t buffer[256];
+			ucg_int buffer_len = build_bad_sequence_input(b, offset, buffer);
+			if (test_iterator(buffer, buffer_len) != 0) {
+				fprintf(stderr, "(#% 4li) iterator disagrees with decoder after %li bytes of malformed input\n", b, offset);
+				failed += 1;
+			}
+			completed += 1;
+		}
+	}
+
+	printf("Running stream tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_stream((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) stream disagrees with decoder: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_stream(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) stream disagrees with decoder on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running buffered output tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_buffered((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) buffered output disagrees with decoder: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_buffered(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) buffered output disagrees with decoder on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running column output tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_columns((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) column output disagrees with decoder: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_columns(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) column output disagrees with decoder on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running fused rune and grapheme tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_runes_and_graphemes((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) fused runes and graphemes disagree with decoder: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_runes_and_graphemes(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) fused runes and graphemes disagree with decoder on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running UTF-16 and UTF-32 tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_utf16_utf32((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) UTF-16 or UTF-32 disagrees with UTF-8: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_utf16_utf32(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) UTF-16 or UTF-32 disagrees with UTF-8 on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	{
+		typedef struct {
+			uint16_t str[4];
+			ucg_int str_len;
+			ucg_int expected_result;
+			ucg_int expected_runes;
+		} utf16_case;
+
+		static const utf16_case utf16_cases[] = {
+			{{'a', 0xDC00, 'b'},        3, UCG_INVALID_RUNE,        1},
+			{{'a', 0xD800, 'b'},        3, UCG_INVALID_RUNE,        1},
+			{{'a', 0xD800, 0xD800},     3, UCG_INVALID_RUNE,        1},
+			{{'a', 'b', 0xDBFF},        3, UCG_EXPECTED_MORE_BYTES, 2},
+			{{0xD83D, 0xDE00, 'a'},     3, 0,                       2},
+			{{0xDBFF, 0xDFFF},          2, 0,                       1},
+		};
+		for (ucg_int i = 0; i < (ucg_int)(sizeof(utf16_cases) / sizeof(utf16_case)); i += 1) {
+			utf16_case t = utf16_cases[i];
+			ucg_int rune_count;
+			ucg_int result = ucg_decode_grapheme_clusters_utf16(NULL, t.str, t.str_len, NULL, &rune_count, NULL, NULL);
+			if (result != t.expected_result || rune_count != t.expected_runes) {
+				fprintf(stderr, "(#% 4li) UTF-16: result %li, runes %li\n", i, result, rune_count);
+				failed += 1;
+			}
+			completed += 1;
+		}
+
+		static const uint32_t utf32_invalid[] = {0xD800, 0xDFFF, 0x110000, 0xFFFFFFFF};
+		for (ucg_int i = 0; i < (ucg_int)(sizeof(utf32_invalid) / sizeof(uint32_t)); i += 1) {
+			uint32_t str[3] = {'a', utf32_invalid[i], 'b'};
+			ucg_int rune_count;
+			ucg_int result = ucg_decode_grapheme_clusters_utf32(NULL, str, 3, NULL, &rune_count, NULL, NULL);
+			if (result != UCG_INVALID_RUNE || rune_count != 1) {
+				fprintf(stderr, "(#% 4li) UTF-32: result %li, runes %li\n", i, result, rune_count);
+				failed += 1;
+			}
+			completed += 1;
+		}
+	}
+
+	printf("Running boundary bitmap tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_boundaries((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) boundary bitmap disagrees with decoder: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_boundaries(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) boundary bitmap disagrees with decoder on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running reverse segmentation tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_reverse((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) reverse segmentation disagrees with iterator: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		if (long_input_test_cases[i].expected_result != 0) {
+			continue;
+		}
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_reverse(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) reverse segmentation disagrees with iterator on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running bounded lookback tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(lookback_test_units) / sizeof(lookback_test_units[0])); i += 1) {
+		if (test_bounded_lookback(lookback_test_units[i]) != 0) {
+			fprintf(stderr, "(#% 4li) boundary search read too far back: %s\n", i, lookback_test_units[i]);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running boundary lookup tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_find_boundary((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) boundary lookup disagrees with iterator: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		if (long_input_test_cases[i].expected_result != 0) {
+			continue;
+		}
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_find_boundary(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) boundary lookup disagrees with iterator on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running summary tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_summary((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) merged summaries disagree with decoder: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_summary(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) merged summaries disagree with decoder on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running truncation tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_truncate((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) truncation disagrees with iterator: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		long_test_case t = long_input_test_cases[i];
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(t, buffer);
+		if (t.expected_result == 0) {
+			if (test_truncate(buffer, buffer_len) != 0) {
+				fprintf(stderr, "(#% 4li) truncation disagrees with iterator on long input\n", i);
+				failed += 1;
+			}
+		} else {
+			// The error is only reported if the string is read that far.
+			ucg_int byte_length, width;
+			if (ucg_truncate_to_width(buffer, buffer_len, t.expected_width, 0, &byte_length, &width) != t.expected_result ||
+			    width != t.expected_width ||
+			    ucg_truncate_to_width(buffer, buffer_len, t.expected_width - 1, 0, &byte_length, &width) != 0 ||
+			    width != t.expected_width - 1)
+			{
+				fprintf(stderr, "(#% 4li) truncation mishandles invalid input\n", i);
+				failed += 1;
+			}
+		}
+		completed += 1;
+	}
+
+	printf("Running line wrapping tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_wrap((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) line wrapping disagrees with iterator: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_wrap(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) line wrapping disagrees with iterator on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running column index tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_column_index((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) column index disagrees with iterator: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_column_index(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) column index disagrees with iterator on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running incremental segmentation tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_segmentation((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) edited segmentation disagrees with decoder: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_segmentation(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) edited segmentation disagrees with decoder on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running rune count tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_rune_count((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) rune count disagrees with full count: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_rune_count(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) rune count disagrees with full count on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int b = 0; b < BAD_SEQUENCE_COUNT; b += 1) {
+		for (ucg_int offset = 0; offset < BAD_SEQUENCE_OFFSETS; offset += 1) {
+			uint8_t buffer[256];
+			ucg_int buffer_len = build_bad_sequence_input(b, offset, buffer);
+			if (test_rune_count(buffer, buffer_len) != 0) {
+				fprintf(stderr, "rune count disagrees with full count: bad sequence %li at %li\n", b, offset);
+				failed += 1;
+			}
+			completed += 1;
+		}
+	}
+
+	printf("Running bulk rune decoding tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_decode_runes((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) bulk decoding disagrees with ucg_decode_rune: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_decode_runes(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) bulk decoding disagrees with ucg_decode_rune on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int b = 0; b < BAD_SEQUENCE_COUNT; b += 1) {
+		for (ucg_int offset = 0; offset < BAD_SEQUENCE_OFFSETS; offset += 1) {
+			uint8_t buffer[256];
+			ucg_int buffer_len = build_bad_sequence_input(b, offset, buffer);
+			if (test_decode_runes(buffer, buffer_len) != 0) {
+				fprintf(stderr, "bulk decoding disagrees with ucg_decode_rune: bad sequence %li at %li\n", b, offset);
+				failed += 1;
+			}
+			completed += 1;
+		}
+	}
+
+	printf("Running limited count tests ...\n");
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+		test_case t = official_grapheme_break_test_cases[i];
+		if (test_limited((uint8_t*)t.str, (ucg_int)strlen(t.str)) != 0) {
+			fprintf(stderr, "(#% 4li) limited count disagrees with iterator: %s\n", i, t.str);
+			failed += 1;
+		}
+		completed += 1;
+	}
+	for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+		uint8_t buffer[4096];
+		ucg_int buffer_len = build_long_input(long_input_test_cases[i], buffer);
+		if (test_limited(buffer, buffer_len) != 0) {
+			fprintf(stderr, "(#% 4li) limited count disagrees with iterator on long input\n", i);
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running batch count tests ...\n");
+	{
+		// Lay out the official test cases and the long inputs as one column of
+		// strings, with an empty string in between each.
+		static uint8_t data[1024 * 1024];
+		static int32_t offsets[16384];
+		ucg_int string_count = 0;
+		ucg_int data_len = 0;
+
+		offsets[0] = 0;
+		for (ucg_int i = 0; i < (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case)); i += 1) {
+			test_case t = official_grapheme_break_test_cases[i];
+			memcpy(data + data_len, t.str, strlen(t.str));
+			data_len += (ucg_int)strlen(t.str);
+			offsets[++string_count] = (int32_t)data_len;
+			offsets[++string_count] = (int32_t)data_len;
+		}
+		for (ucg_int i = 0; i < (ucg_int)(sizeof(long_input_test_cases) / sizeof(long_test_case)); i += 1) {
+			data_len += build_long_input(long_input_test_cases[i], data + data_len);
+			offsets[++string_count] = (int32_t)data_len;
+			offsets[++string_count] = (int32_t)data_len;
+		}
+
+		static ucg_int results[16384], rune_counts[16384], grapheme_counts[16384], widths[16384];
+		ucg_int batch_failed = ucg_grapheme_count_batch(data, offsets, string_count, results, rune_counts, grapheme_counts, widths);
+
+		ucg_int expected_failed = 0;
+		for (ucg_int i = 0; i < string_count; i += 1) {
+			ucg_int rune_count, grapheme_count, width;
+			ucg_int result = ucg_grapheme_count(data + offsets[i], offsets[i + 1] - offsets[i], &rune_count, &grapheme_count, &width);
+			if (result != results[i] ||
+			    rune_count != rune_counts[i] ||
+			    grapheme_count != grapheme_counts[i] ||
+			    width != widths[i])
+			{
+				fprintf(stderr, "(#% 4li) batch count disagrees with decoder\n", i);
+				failed += 1;
+			}
+			expected_failed += result != 0;
+			completed += 1;
+		}
+
+		if (batch_failed != expected_failed ||
+		    ucg_grapheme_count_batch(data, offsets, string_count, NULL, NULL, NULL, NULL) != expected_failed)
+		{
+			fprintf(stderr, "batch count reports the wrong number of failures\n");
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running parallel segmentation tests ...\n");
+	{
+		// Stitch the official test cases together until there is enough text
+		// to be worth splitting.
+		static uint8_t buffer[2 * 1024 * 1024];
+		ucg_int buffer_len = 0;
+		for (ucg_int i = 0; buffer_len < (ucg_int)sizeof(buffer) - 256; i += 1) {
+			test_case t = official_grapheme_break_test_cases[i % (ucg_int)(sizeof(official_grapheme_break_test_cases) / sizeof(test_case))];
+			memcpy(buffer + buffer_len, t.str, strlen(t.str));
+			buffer_len += (ucg_int)strlen(t.str);
+		}
+
+		if (test_parallel(buffer, buffer_len) != 0) {
+			fprintf(stderr, "parallel segmentation disagrees with decoder\n");
+			failed += 1;
+		}
+		completed += 1;
+
+		buffer[buffer_len * 2 / 3] = 0xFF;
+		if (test_parallel(buffer, buffer_len) != 0) {
+			fprintf(stderr, "parallel segmentation disagrees with decoder on invalid input\n");
+			failed += 1;
+		}
+		completed += 1;
+	}
+
+	printf("Running exhaustive property table tests ...\n");
+	if (test_property_tables() != 0) {
+		failed += 1;
+	}
+	completed += 1;
+
 	fprintf(stderr, "Tests failed: % 4li/% 4li\n", failed, completed);
 
 	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
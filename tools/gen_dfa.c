@@ -0,0 +1,307 @@
+/*
+ * SPDX-FileCopyrightText: (c) 2024 Feoramund
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// This program generates `src/ucg_dfa.h`, the state machine that decides
+// grapheme cluster boundaries with one table lookup per rune.
+//
+// Rather than restating the rules, it drives the chain of rules in `ucg.c`
+// itself. Every state the chain can be in is reduced to the handful of fields
+// that the rules actually read, the reachable states are explored one rune
+// class at a time, and the result is minimized.
+//
+// Usage: gen_dfa > src/ucg_dfa.h
+
+#include <stdio.h>
+
+#include "../src/ucg.c"
+
+// The rules only ever look at the Grapheme_Cluster_Break class, the
+// Indic_Conjunct_Break class and the Extended_Pictographic flag of a rune,
+// which are the low 7 bits of its record.
+#define KEY_COUNT 128
+#define KEY_MASK  (KEY_COUNT - 1)
+
+#define MAX_STATES 1024
+
+typedef struct {
+	int  last_key;
+	bool bypass_next_rune;
+	bool last_rune_breaks_forward;
+	int  current_sequence;
+	int  regional_indicator_parity;
+	bool started;
+} abstract_state;
+
+static ucg_rune class_runes[KEY_COUNT];
+static int      class_keys[KEY_COUNT];
+static int      class_of_key[KEY_COUNT];
+static int      class_count = 0;
+
+static abstract_state states[MAX_STATES];
+static int            state_count = 0;
+
+static int  next_state[MAX_STATES][KEY_COUNT];
+static bool breaks[MAX_STATES][KEY_COUNT];
+
+static int  block_of[MAX_STATES];
+static int  new_block_of[MAX_STATES];
+
+static abstract_state abstract(const ucg_decoder_state* s) {
+	abstract_state a;
+	a.last_key                  = s->last_properties & KEY_MASK;
+	a.bypass_next_rune          = s->bypass_next_rune;
+	a.last_rune_breaks_forward  = s->last_rune_breaks_forward;
+	a.current_sequence          = (int)s->current_sequence;
+	a.regional_indicator_parity = (int)(s->regional_indicator_counter & 1);
+	a.started                   = s->rune_count > 0;
+	return a;
+}
+
+static ucg_decoder_state concrete(const abstract_state* a) {
+	ucg_decoder_state s;
+	memset(&s, 0, sizeof(s));
+
+	if (a->started) {
+		ucg_rune r = class_runes[class_of_key[a->last_key]];
+		s.last_rune = r;
+		s.last_properties = ucg_lookup_properties(r);
+		s.rune_count = 1;
+		s.grapheme_count = 1;
+		s.last_grapheme_count = 1;
+	}
+
+	s.bypass_next_rune = a->bypass_next_rune;
+	s.last_rune_breaks_forward = a->last_rune_breaks_forward;
+	s.current_sequence = (ucg_grapheme_cluster_sequence)a->current_sequence;
+	s.regional_indicator_counter = a->regional_indicator_parity;
+	return s;
+}
+
+static int find_or_add(const abstract_state* a) {
+	for (int i = 0; i < state_count; i += 1) {
+		if (memcmp(&states[i], a, sizeof(*a)) == 0) {
+			return i;
+		}
+	}
+	if (state_count == MAX_STATES) {
+		fprintf(stderr, "Too many states.\n");
+		exit(EXIT_FAILURE);
+	}
+	states[state_count] = *a;
+	state_count += 1;
+	return state_count - 1;
+}
+
+int main(void) {
+	// Pick one rune to stand in for each combination of properties.
+	for (int k = 0; k < KEY_COUNT; k += 1) {
+		class_of_key[k] = -1;
+	}
+	for (ucg_rune r = 0; r <= 0x10FFFF; r += 1) {
+		int k = ucg_lookup_properties(r) & KEY_MASK;
+		if (class_of_key[k] < 0) {
+			class_of_key[k] = class_count;
+			class_keys[class_count] = k;
+			class_runes[class_count] = r;
+			class_count += 1;
+		}
+	}
+
+	// Explore every reachable state, starting with the empty one.
+	abstract_state start;
+	memset(&start, 0, sizeof(start));
+	{
+		ucg_decoder_state s;
+		memset(&s, 0, sizeof(s));
+		start = abstract(&s);
+	}
+	find_or_add(&start);
+
+	for (int i = 0; i < state_count; i += 1) {
+		for (int c = 0; c < class_count; c += 1) {
+			ucg_decoder_state s = concrete(&states[i]);
+			ucg_int before = s.grapheme_count;
+
+			ucg_rune r = class_runes[c];
+			ucg_properties p = ucg_lookup_properties(r);
+			_ucg_decode_grapheme_clusters_rules(&s, r, p);
+			_ucg_decode_grapheme_clusters_deferred_step(NULL, NULL, &s, 0, r, p);
+
+			abstract_state a = abstract(&s);
+			next_state[i][c] = find_or_add(&a);
+			breaks[i][c] = s.grapheme_count > before;
+		}
+	}
+
+	// The rules also test ranges of runes along the way, so make sure that
+	// every rune behaves exactly like the rune standing in for it.
+	for (int i = 0; i < state_count; i += 1) {
+		for (ucg_rune r = 0; r <= 0x10FFFF; r += 1) {
+			ucg_decoder_state s = concrete(&states[i]);
+			ucg_int before = s.grapheme_count;
+
+			ucg_properties p = ucg_lookup_properties(r);
+			int c = class_of_key[p & KEY_MASK];
+			_ucg_decode_grapheme_clusters_rules(&s, r, p);
+			_ucg_decode_grapheme_clusters_deferred_step(NULL, NULL, &s, 0, r, p);
+
+			abstract_state a = abstract(&s);
+			if (memcmp(&states[next_state[i][c]], &a, sizeof(a)) != 0 || breaks[i][c] != (s.grapheme_count > before)) {
+				fprintf(stderr, "U+%04X does not behave like U+%04X.\n", (unsigned)r, (unsigned)class_runes[c]);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	// Minimize by splitting blocks of states until every state in a block
+	// breaks on the same classes and moves into the same blocks.
+	int block_count = 1;
+	for (int i = 0; i < state_count; i += 1) {
+		block_of[i] = 0;
+	}
+	for (;;) {
+		int new_block_count = 0;
+		for (int i = 0; i < state_count; i += 1) {
+			new_block_of[i] = -1;
+			for (int j = 0; j < i; j += 1) {
+				if (block_of[i] != block_of[j]) {
+					continue;
+				}
+				bool same = true;
+				for (int c = 0; c < class_count && same; c += 1) {
+					same = breaks[i][c] == breaks[j][c] &&
+					       block_of[next_state[i][c]] == block_of[next_state[j][c]];
+				}
+				if (same) {
+					new_block_of[i] = new_block_of[j];
+					break;
+				}
+			}
+			if (new_block_of[i] < 0) {
+				new_block_of[i] = new_block_count;
+				new_block_count += 1;
+			}
+		}
+		memcpy(block_of, new_block_of, sizeof(block_of));
+		if (new_block_count == block_count) {
+			break;
+		}
+		block_count = new_block_count;
+	}
+
+	if (class_count > 32) {
+		fprintf(stderr, "Too many classes for the sync mask.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (block_count > 0x7F) {
+		fprintf(stderr, "Too many states for the break bit.\n");
+		return EXIT_FAILURE;
+	}
+
+	// A class synchronizes the machine if every state moves into the same
+	// state on it, so that what follows does not depend on what came before.
+	uint32_t sync_classes = 0;
+	for (int c = 0; c < class_count; c += 1) {
+		bool sync = true;
+		for (int i = 1; i < state_count && sync; i += 1) {
+			sync = block_of[next_state[i][c]] == block_of[next_state[0][c]];
+		}
+		if (sync) {
+			sync_classes |= (uint32_t)1 << c;
+		}
+	}
+
+	// The states that the machine can be in after at least one rune, for
+	// restarting it in the middle of text.
+	if (block_count > 32) {
+		fprintf(stderr, "Too many states for the resume mask.\n");
+		return EXIT_FAILURE;
+	}
+
+	uint32_t resume_states = 0;
+	for (int i = 0; i < state_count; i += 1) {
+		for (int c = 0; c < class_count; c += 1) {
+			resume_states |= (uint32_t)1 << block_of[next_state[i][c]];
+		}
+	}
+
+	// The state after any printable ASCII rune, for the bulk path.
+	int after_ascii = block_of[next_state[0][class_of_key[ucg_lookup_properties('a') & KEY_MASK]]];
+
+	printf(
+		"/*\n"
+		" * SPDX-FileCopyrightText: (c) 2024 Feoramund\n"
+		" * SPDX-License-Identifier: BSD-3-Clause\n"
+		" */\n"
+		"#ifndef _UCG_DFA_INCLUDED\n"
+		"#define _UCG_DFA_INCLUDED\n"
+		"\n"
+		"#ifdef __cplusplus\n"
+		"extern \"C\" {\n"
+		"#endif\n"
+		"\n"
+		"#include <stdint.h>\n"
+		"\n"
+		"//\n"
+		"// This file is generated by `tools/gen_dfa.c` from the rules in `ucg.c`.\n"
+		"// Do not edit it by hand.\n"
+		"//\n"
+		"// The low 7 bits of a rune's record select its class through\n"
+		"// `ucg_gcb_dfa_classes`. Each entry of `ucg_gcb_dfa` is the next state,\n"
+		"// with `UCG_GCB_DFA_BREAK` set if a grapheme begins with the rune.\n"
+		"//\n"
+		"\n"
+		"#define UCG_GCB_DFA_CLASS_COUNT %i\n"
+		"#define UCG_GCB_DFA_STATE_COUNT %i\n"
+		"\n"
+		"#define UCG_GCB_DFA_CLASS_MASK  0x%02X\n"
+		"#define UCG_GCB_DFA_STATE_MASK  0x7F\n"
+		"#define UCG_GCB_DFA_BREAK       0x80\n"
+		"\n"
+		"// The state at the start of text.\n"
+		"#define UCG_GCB_DFA_START       %i\n"
+		"// The state after any rune of printable 7-bit ASCII.\n"
+		"#define UCG_GCB_DFA_ASCII       %i\n"
+		"\n"
+		"// The classes after which the state no longer depends on any earlier rune,\n"
+		"// one bit per class.\n"
+		"#define UCG_GCB_DFA_SYNC_CLASSES 0x%05X\n"
+		"\n"
+		"// The states that the machine can be in after any rune, one bit per state.\n"
+		"#define UCG_GCB_DFA_RESUME_STATES 0x%06X\n"
+		"\n",
+		class_count, block_count, KEY_MASK, block_of[0], after_ascii, (unsigned)sync_classes, (unsigned)resume_states);
+
+	printf("static const uint8_t ucg_gcb_dfa_classes[%i] = {", KEY_COUNT);
+	for (int k = 0; k < KEY_COUNT; k += 1) {
+		printf(k % 16 == 0 ? "\n\t" : " ");
+		printf("%2i,", class_of_key[k] < 0 ? 0 : class_of_key[k]);
+	}
+	printf("\n};\n\n");
+
+	printf("static const uint8_t ucg_gcb_dfa[%i][%i] = {\n", block_count, class_count);
+	for (int b = 0; b < block_count; b += 1) {
+		int i = 0;
+		while (block_of[i] != b) {
+			i += 1;
+		}
+		printf("\t{");
+		for (int c = 0; c < class_count; c += 1) {
+			printf("0x%02X%s", block_of[next_state[i][c]] | (breaks[i][c] ? 0x80 : 0), c + 1 < class_count ? ", " : "");
+		}
+		printf("},\n");
+	}
+	printf("};\n\n");
+
+	printf(
+		"#ifdef __cplusplus\n"
+		"}\n"
+		"#endif\n"
+		"\n"
+		"#endif /* _UCG_DFA_INCLUDED */\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,306 @@
+/*
+ * SPDX-FileCopyrightText: (c) 2024 Feoramund
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// This program generates `src/ucg_trie.h`, the two-stage lookup table that
+// packs every property the segmentation rules need into one record per
+// codepoint.
+//
+// The source of truth is the set of ranges in `src/ucg_tables.h`, along with
+// the smaller properties that UCG checks with plain comparisons.
+//
+// Usage: gen_trie > src/ucg_trie.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/ucg.h"
+#include "../src/ucg_tables.h"
+
+#define TABLE_LEN(t) (sizeof(t) / sizeof(ucg_rune))
+
+#define MAX_RUNE    0x10FFFF
+#define BLOCK_SHIFT 8
+#define BLOCK_SIZE  (1 << BLOCK_SHIFT)
+#define BLOCK_COUNT ((MAX_RUNE + 1) / BLOCK_SIZE)
+
+// This must be kept in sync with the layout emitted below.
+enum {
+	GCB_OTHER,
+	GCB_CR,
+	GCB_LF,
+	GCB_CONTROL,
+	GCB_EXTEND,
+	GCB_ZWJ,
+	GCB_REGIONAL_INDICATOR,
+	GCB_PREPEND,
+	GCB_SPACING_MARK,
+	GCB_L,
+	GCB_V,
+	GCB_T,
+	GCB_LV,
+	GCB_LVT,
+};
+
+enum {
+	INCB_NONE,
+	INCB_LINKER,
+	INCB_CONSONANT,
+	INCB_EXTEND,
+};
+
+#define PROPERTY_INCB_SHIFT             4
+#define PROPERTY_EXTENDED_PICTOGRAPHIC  (1 << 6)
+#define PROPERTY_WIDTH_SHIFT            7
+#define PROPERTY_SPACING_MARK           (1 << 9)
+#define PROPERTY_NONSPACING_MARK        (1 << 10)
+#define PROPERTY_GRAPHEME_EXTEND        (1 << 11)
+
+static unsigned short records[256];
+static int record_count = 0;
+
+static unsigned char record_index[MAX_RUNE + 1];
+
+static unsigned char stage1[BLOCK_COUNT];
+static unsigned char stage2[256][BLOCK_SIZE];
+static int block_count = 0;
+
+static bool in_ranges(ucg_rune r, const ucg_rune* table, size_t length, size_t stride) {
+	size_t lo = 0;
+	size_t hi = length / stride;
+	while (lo < hi) {
+		size_t m = lo + (hi - lo) / 2;
+		if (r < table[m * stride]) {
+			hi = m;
+		} else if (r > table[m * stride + (stride == 1 ? 0 : 1)]) {
+			lo = m + 1;
+		} else {
+			return true;
+		}
+	}
+	return false;
+}
+
+#define IN_RANGES(r, t) in_ranges((r), (t), TABLE_LEN(t), 2)
+
+static int width_of(ucg_rune r) {
+	if (ucg_is_control(r)) {
+		return 0;
+	} else if (r <= 0x10FF) {
+		return 1;
+	}
+
+	switch (r) {
+	case 0xFEFF:
+	case 0x200B:
+	case 0x200C:
+	case 0x200D:
+	case 0x2060:
+		return 0;
+	}
+
+	const ucg_rune* t = ucg_normalized_east_asian_width_ranges;
+	for (size_t i = 0; i < TABLE_LEN(ucg_normalized_east_asian_width_ranges); i += 3) {
+		if (t[i] <= r && r <= t[i + 1]) {
+			return (int)t[i + 2];
+		}
+	}
+	return 1;
+}
+
+// The class is assigned in the same order that the segmentation rules test
+// for each property, so that one lookup gives the same answer as the chain.
+static int gcb_of(ucg_rune r) {
+	if (r == '\r')                            { return GCB_CR; }
+	if (r == '\n')                            { return GCB_LF; }
+	if (ucg_is_control(r))                    { return GCB_CONTROL; }
+
+	if (ucg_is_hangul_syllable_leading(r))    { return GCB_L; }
+	if (ucg_is_hangul_syllable_vowel(r))      { return GCB_V; }
+	if (ucg_is_hangul_syllable_trailing(r))   { return GCB_T; }
+	if (in_ranges(r, ucg_hangul_syllable_lv_singlets, TABLE_LEN(ucg_hangul_syllable_lv_singlets), 1)) { return GCB_LV; }
+	if (IN_RANGES(r, ucg_hangul_syllable_lvt_ranges)) { return GCB_LVT; }
+
+	if (r == 0x200D)                          { return GCB_ZWJ; }
+	if (IN_RANGES(r, ucg_grapheme_extend_ranges) || ucg_is_emoji_modifier(r)) { return GCB_EXTEND; }
+	if (IN_RANGES(r, ucg_spacing_mark_ranges)) { return GCB_SPACING_MARK; }
+
+	if (ucg_is_indic_consonant_preceding_repha(r) ||
+	    ucg_is_indic_consonant_prefixed(r)        ||
+	    ucg_is_prepended_concatenation_mark(r))
+	{
+		return GCB_PREPEND;
+	}
+
+	if (ucg_is_regional_indicator(r))         { return GCB_REGIONAL_INDICATOR; }
+
+	return GCB_OTHER;
+}
+
+static int incb_of(ucg_rune r) {
+	if (ucg_is_indic_conjunct_break_linker(r))                 { return INCB_LINKER; }
+	if (IN_RANGES(r, ucg_indic_conjunct_break_consonant_ranges)) { return INCB_CONSONANT; }
+	if (IN_RANGES(r, ucg_indic_conjunct_break_extend_ranges))    { return INCB_EXTEND; }
+	return INCB_NONE;
+}
+
+static unsigned short record_of(ucg_rune r) {
+	unsigned short record = (unsigned short)gcb_of(r);
+
+	record |= (unsigned short)(incb_of(r) << PROPERTY_INCB_SHIFT);
+	record |= (unsigned short)(width_of(r) << PROPERTY_WIDTH_SHIFT);
+
+	if (IN_RANGES(r, ucg_emoji_extended_pictographic_ranges)) { record |= PROPERTY_EXTENDED_PICTOGRAPHIC; }
+	if (IN_RANGES(r, ucg_spacing_mark_ranges))                { record |= PROPERTY_SPACING_MARK; }
+	if (IN_RANGES(r, ucg_nonspacing_mark_ranges))             { record |= PROPERTY_NONSPACING_MARK; }
+	if (IN_RANGES(r, ucg_grapheme_extend_ranges))             { record |= PROPERTY_GRAPHEME_EXTEND; }
+
+	return record;
+}
+
+static void print_array(const char* type, const char* name, const unsigned char* data, int length) {
+	printf("static const %s %s[%i] = {", type, name, length);
+	for (int i = 0; i < length; i += 1) {
+		printf(i % 16 == 0 ? "\n\t" : " ");
+		printf("0x%02X,", data[i]);
+	}
+	printf("\n};\n\n");
+}
+
+int main(void) {
+	for (ucg_rune r = 0; r <= MAX_RUNE; r += 1) {
+		unsigned short record = record_of(r);
+
+		int i = 0;
+		for (/**/; i < record_count; i += 1) {
+			if (records[i] == record) {
+				break;
+			}
+		}
+		if (i == record_count) {
+			if (record_count == 256) {
+				fprintf(stderr, "Too many distinct records for one-byte indices.\n");
+				return EXIT_FAILURE;
+			}
+			records[record_count] = record;
+			record_count += 1;
+		}
+		record_index[r] = (unsigned char)i;
+	}
+
+	for (int b = 0; b < BLOCK_COUNT; b += 1) {
+		const unsigned char* block = record_index + b * BLOCK_SIZE;
+
+		int i = 0;
+		for (/**/; i < block_count; i += 1) {
+			if (memcmp(stage2[i], block, BLOCK_SIZE) == 0) {
+				break;
+			}
+		}
+		if (i == block_count) {
+			if (block_count == 256) {
+				fprintf(stderr, "Too many distinct blocks for one-byte indices.\n");
+				return EXIT_FAILURE;
+			}
+			memcpy(stage2[i], block, BLOCK_SIZE);
+			block_count += 1;
+		}
+		stage1[b] = (unsigned char)i;
+	}
+
+	printf(
+		"/*\n"
+		" * SPDX-FileCopyrightText: (c) 2024 Feoramund\n"
+		" * SPDX-License-Identifier: BSD-3-Clause\n"
+		" */\n"
+		"#ifndef _UCG_TRIE_INCLUDED\n"
+		"#define _UCG_TRIE_INCLUDED\n"
+		"\n"
+		"#ifdef __cplusplus\n"
+		"extern \"C\" {\n"
+		"#endif\n"
+		"\n"
+		"#include <stdint.h>\n"
+		"\n"
+		"//\n"
+		"// This file is generated by `tools/gen_trie.c` from the tables in\n"
+		"// `ucg_tables.h`. Do not edit it by hand.\n"
+		"//\n"
+		"// Each codepoint maps to a 16-bit record of its properties through two\n"
+		"// stages: `ucg_trie_stage1[r >> %i]` selects a block of %i entries in\n"
+		"// `ucg_trie_stage2`, and the entry for `r & 0x%X` in that block is an\n"
+		"// index into `ucg_trie_records`.\n"
+		"//\n"
+		"\n"
+		"typedef uint16_t ucg_properties;\n"
+		"\n"
+		"// Grapheme_Cluster_Break, as seen by the segmentation rules. Where a rune has\n"
+		"// more than one of these properties, the one that the rules test first wins.\n"
+		"#define UCG_GCB_OTHER              %i\n"
+		"#define UCG_GCB_CR                 %i\n"
+		"#define UCG_GCB_LF                 %i\n"
+		"#define UCG_GCB_CONTROL            %i\n"
+		"#define UCG_GCB_EXTEND             %i\n"
+		"#define UCG_GCB_ZWJ                %i\n"
+		"#define UCG_GCB_REGIONAL_INDICATOR %i\n"
+		"#define UCG_GCB_PREPEND            %i\n"
+		"#define UCG_GCB_SPACING_MARK       %i\n"
+		"#define UCG_GCB_L                  %i\n"
+		"#define UCG_GCB_V                  %i\n"
+		"#define UCG_GCB_T                  %i\n"
+		"#define UCG_GCB_LV                 %i\n"
+		"#define UCG_GCB_LVT                %i\n"
+		"\n"
+		"// Indic_Conjunct_Break\n"
+		"#define UCG_INCB_NONE      %i\n"
+		"#define UCG_INCB_LINKER    %i\n"
+		"#define UCG_INCB_CONSONANT %i\n"
+		"#define UCG_INCB_EXTEND    %i\n"
+		"\n"
+		"#define UCG_PROPERTY_GCB(p)   ((p) & 0xF)\n"
+		"#define UCG_PROPERTY_INCB(p)  (((p) >> %i) & 0x3)\n"
+		"#define UCG_PROPERTY_WIDTH(p) (((p) >> %i) & 0x3)\n"
+		"\n"
+		"#define UCG_PROPERTY_EXTENDED_PICTOGRAPHIC 0x%04X\n"
+		"#define UCG_PROPERTY_SPACING_MARK          0x%04X\n"
+		"#define UCG_PROPERTY_NONSPACING_MARK       0x%04X\n"
+		"#define UCG_PROPERTY_GRAPHEME_EXTEND       0x%04X\n"
+		"\n"
+		"#define UCG_TRIE_BLOCK_SHIFT %i\n"
+		"#define UCG_TRIE_BLOCK_MASK  0x%X\n"
+		"\n"
+		"// This is the record of any rune past the last codepoint.\n"
+		"#define UCG_TRIE_DEFAULT_PROPERTIES 0x%04X\n"
+		"\n",
+		BLOCK_SHIFT, BLOCK_SIZE, BLOCK_SIZE - 1,
+		GCB_OTHER, GCB_CR, GCB_LF, GCB_CONTROL, GCB_EXTEND, GCB_ZWJ,
+		GCB_REGIONAL_INDICATOR, GCB_PREPEND, GCB_SPACING_MARK,
+		GCB_L, GCB_V, GCB_T, GCB_LV, GCB_LVT,
+		INCB_NONE, INCB_LINKER, INCB_CONSONANT, INCB_EXTEND,
+		PROPERTY_INCB_SHIFT, PROPERTY_WIDTH_SHIFT,
+		PROPERTY_EXTENDED_PICTOGRAPHIC, PROPERTY_SPACING_MARK,
+		PROPERTY_NONSPACING_MARK, PROPERTY_GRAPHEME_EXTEND,
+		BLOCK_SHIFT, BLOCK_SIZE - 1,
+		GCB_OTHER | (1 << PROPERTY_WIDTH_SHIFT));
+
+	printf("static const ucg_properties ucg_trie_records[%i] = {", record_count);
+	for (int i = 0; i < record_count; i += 1) {
+		printf(i % 8 == 0 ? "\n\t" : " ");
+		printf("0x%04X,", records[i]);
+	}
+	printf("\n};\n\n");
+
+	print_array("uint8_t", "ucg_trie_stage1", stage1, BLOCK_COUNT);
+	print_array("uint8_t", "ucg_trie_stage2", &stage2[0][0], block_count * BLOCK_SIZE);
+
+	printf(
+		"#ifdef __cplusplus\n"
+		"}\n"
+		"#endif\n"
+		"\n"
+		"#endif /* _UCG_TRIE_INCLUDED */\n");
+
+	return EXIT_SUCCESS;
+}